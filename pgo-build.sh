@@ -0,0 +1,37 @@
+#! /bin/bash
+# Profile guided build of the controller.
+# Usage: ./pgo-build.sh [telemetry log ...]
+#
+# 1. build-release: plain Release build, timed as the baseline
+# 2. build-pgo: instrumented build, trained on the bench-controller
+#    scenarios and on any recorded telemetry logs given, which drive
+#    the same decode, Session and encode code that pid runs per frame
+# 3. build-pgo: rebuilt with the profile and timed against the baseline
+#
+# Extra CMake options, e.g. CMAKE_ARGS="-DPID_LTO=ON -DPID_MARCH=native",
+# are used for both builds so the report isolates the profile.
+# The comparison is written to pgo-report.json.
+set -e
+cd "$(dirname "$0")"
+LOGS=("$@")
+JOBS=$(nproc 2>/dev/null || echo 2)
+
+cmake -S . -B build-release -DCMAKE_BUILD_TYPE=Release -DPID_PGO=OFF $CMAKE_ARGS
+cmake --build build-release -j"$JOBS"
+build-release/bench-controller "${LOGS[@]}" > build-release/bench-controller.json
+
+rm -rf build-pgo/pgo
+cmake -S . -B build-pgo -DCMAKE_BUILD_TYPE=Release -DPID_PGO=GENERATE $CMAKE_ARGS
+cmake --build build-pgo -j"$JOBS"
+build-pgo/bench-controller --repeat 3 "${LOGS[@]}" > /dev/null
+for log in "${LOGS[@]}"; do
+    build-pgo/pid-replay "$log" > /dev/null
+done
+if ls build-pgo/pgo/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -output=build-pgo/pgo/pid.profdata build-pgo/pgo/*.profraw
+fi
+
+cmake -S . -B build-pgo -DPID_PGO=USE
+cmake --build build-pgo -j"$JOBS"
+build-pgo/bench-controller --compare build-release/bench-controller.json "${LOGS[@]}" > pgo-report.json
+echo "Wrote pgo-report.json"
@@ -0,0 +1,237 @@
+//
+//  BayesOpt.cpp
+//  pid
+//
+// Class BayesOpt
+// Each candidate length scale keeps its own kernel matrix, which only
+// ever grows by a row, so its Cholesky factor is extended in O(n^2) per
+// lap instead of refactored. The targets are the log errors, clipped
+// and standardized, and are refitted with two triangular solves per
+// length scale; the one with the largest marginal likelihood is used.
+//
+
+#include <algorithm>
+#include <math.h>
+#include "BayesOpt.h"
+
+using namespace std;
+
+BayesOpt::BayesOpt(unsigned seed): model(0), L(nullptr), yMean(0.), yScale(1.), generator(seed), p_num(0),
+    p(nullptr), error(0.), best_error(HUGE_VAL), initialSamples(0), maxEvaluations(0),
+    lengthScales{0.05, 0.1, 0.2, 0.4}, noise(1.e-4), clip(5.), candidates(2000), localCandidates(1000),
+    count(0) {};
+
+BayesOpt::~BayesOpt() {};
+
+void BayesOpt::Init(double *p, const double *lower, const double *upper, int p_num, int maxEvaluations) {
+    this->p = p;
+    this->p_num = p_num;
+    this->lower.assign(lower, lower + p_num);
+    this->upper.assign(upper, upper + p_num);
+    this->maxEvaluations = maxEvaluations;
+    initialSamples = 2*p_num;
+    X.clear();
+    errors.clear();
+    factors.assign(lengthScales.size(), vector<double>());
+    model = 0;
+    best.assign(p, p + p_num);
+    best_error = HUGE_VAL;
+    count = 0;
+    
+    // Start from p, kept inside the box
+    for(int j=0; j<p_num; j++)
+        p[j] = fmin(fmax(p[j], lower[j]), upper[j]);
+}
+
+void BayesOpt::ToUnit(const double *p, double *u) {
+    for(int j=0; j<p_num; j++) {
+        if(lower[j] > 0.)
+            u[j] = log(p[j]/lower[j])/log(upper[j]/lower[j]);
+        else
+            u[j] = (p[j] - lower[j])/(upper[j] - lower[j]);
+    }
+}
+
+void BayesOpt::FromUnit(const double *u, double *p) {
+    for(int j=0; j<p_num; j++) {
+        if(lower[j] > 0.)
+            p[j] = lower[j]*pow(upper[j]/lower[j], u[j]);
+        else
+            p[j] = lower[j] + u[j]*(upper[j] - lower[j]);
+    }
+}
+
+double BayesOpt::Kernel(const double *a, const double *b, double lengthScale) {
+    double d2 = 0.;
+    for(int j=0; j<p_num; j++) {
+        double d = (a[j] - b[j])/lengthScale;
+        d2 += d*d;
+    }
+    return exp(-0.5*d2);
+}
+
+void BayesOpt::ForwardSolve(const double *L, double *b, int n) {
+    for(int i=0; i<n; i++) {
+        const double *row = &L[i*(i+1)/2];
+        double s = b[i];
+        for(int k=0; k<i; k++)
+            s -= row[k]*b[k];
+        b[i] = s/row[i];
+    }
+}
+
+void BayesOpt::BackSolve(const double *L, double *b, int n) {
+    for(int i=n-1; i>=0; i--) {
+        double s = b[i];
+        for(int k=i+1; k<n; k++)
+            s -= L[k*(k+1)/2 + i]*b[k];
+        b[i] = s/L[i*(i+1)/2 + i];
+    }
+}
+
+// New row l of L solves L l = k, and the diagonal is what is left of k(u, u)
+void BayesOpt::Extend(const double *u) {
+    int n = int(errors.size()) - 1;
+    vector<double> row(n + 1);
+    for(size_t m=0; m<factors.size(); m++) {
+        for(int i=0; i<n; i++)
+            row[i] = Kernel(&X[i*p_num], u, lengthScales[m]);
+        ForwardSolve(&factors[m][0], &row[0], n);
+        double d = 1. + noise;
+        for(int i=0; i<n; i++)
+            d -= row[i]*row[i];
+        row[n] = sqrt(fmax(d, 1.e-12));
+        factors[m].insert(factors[m].end(), row.begin(), row.end());
+    }
+}
+
+void BayesOpt::Fit() {
+    int n = int(errors.size());
+    
+    // Clipped log errors
+    vector<double> y(n);
+    double yBest = log(fmax(best_error, 1.e-300));
+    for(int i=0; i<n; i++)
+        y[i] = fmin(log(fmax(errors[i], 1.e-300)), yBest + clip);
+    
+    yMean = 0.;
+    for(int i=0; i<n; i++)
+        yMean += y[i];
+    yMean /= n;
+    double var = 0.;
+    for(int i=0; i<n; i++)
+        var += (y[i] - yMean)*(y[i] - yMean);
+    yScale = (n > 1 && var > 0.) ? sqrt(var/n) : 1.;
+    
+    // alpha = L^-T L^-1 y, the log marginal likelihood is
+    // -y.alpha/2 - sum log L_ii up to a constant
+    vector<double> a(n);
+    double bestLikelihood = -HUGE_VAL;
+    for(size_t m=0; m<factors.size(); m++) {
+        const double *Lm = &factors[m][0];
+        for(int i=0; i<n; i++)
+            a[i] = (y[i] - yMean)/yScale;
+        ForwardSolve(Lm, &a[0], n);
+        double likelihood = 0.;
+        for(int i=0; i<n; i++)
+            likelihood -= 0.5*a[i]*a[i] + log(Lm[i*(i+1)/2 + i]);
+        BackSolve(Lm, &a[0], n);
+        if(likelihood > bestLikelihood) {
+            bestLikelihood = likelihood;
+            model = int(m);
+            alpha = a;
+        }
+    }
+    L = &factors[model][0];
+}
+
+void BayesOpt::Predict(const double *u, double &mean, double &sd) {
+    int n = int(errors.size());
+    vector<double> k(n);
+    for(int i=0; i<n; i++)
+        k[i] = Kernel(&X[i*p_num], u, lengthScales[model]);
+    double m = 0.;
+    for(int i=0; i<n; i++)
+        m += k[i]*alpha[i];
+    ForwardSolve(L, &k[0], n);
+    double var = 1.;
+    for(int i=0; i<n; i++)
+        var -= k[i]*k[i];
+    mean = yMean + yScale*m;
+    sd = yScale*sqrt(fmax(var, 1.e-12));
+}
+
+double BayesOpt::ExpectedImprovement(const double *u, double best) {
+    double mean, sd;
+    Predict(u, mean, sd);
+    double z = (best - mean)/sd;
+    double cdf = 0.5*erfc(-z/sqrt(2.));
+    double pdf = exp(-0.5*z*z)/sqrt(2.*M_PI);
+    return (best - mean)*cdf + sd*pdf;
+}
+
+// Candidates are drawn uniformly over the box and around the best gains
+void BayesOpt::Propose() {
+    uniform_real_distribution<double> uniform(0., 1.);
+    vector<double> u(p_num);
+    if(count < initialSamples) {
+        for(int j=0; j<p_num; j++)
+            u[j] = uniform(generator);
+        FromUnit(&u[0], p);
+        return;
+    }
+    
+    normal_distribution<double> normal(0., 0.5*LengthScale());
+    vector<double> center(p_num);
+    ToUnit(&best[0], &center[0]);
+    double yBest = log(fmax(best_error, 1.e-300));
+    vector<double> chosen(p_num);
+    double chosenEI = -1.;
+    for(int c=0; c<candidates; c++) {
+        for(int j=0; j<p_num; j++) {
+            if(c < localCandidates)
+                u[j] = fmin(fmax(center[j] + normal(generator), 0.), 1.);
+            else
+                u[j] = uniform(generator);
+        }
+        double ei = ExpectedImprovement(&u[0], yBest);
+        if(ei > chosenEI) {
+            chosenEI = ei;
+            chosen = u;
+        }
+    }
+    FromUnit(&chosen[0], p);
+}
+
+// Add the error of p to the model and propose the next gains
+// Returns true once maxEvaluations laps have been scored...
+bool BayesOpt::Update() {
+    vector<double> u(p_num);
+    ToUnit(p, &u[0]);
+    X.insert(X.end(), u.begin(), u.end());
+    errors.push_back(error);
+    Extend(&u[0]);
+    if(error < best_error) {
+        best_error = error;
+        best.assign(p, p + p_num);
+    }
+    Fit();
+    count++;
+    
+    if(count >= maxEvaluations) {
+        for(int j=0; j<p_num; j++)
+            p[j] = best[j];
+        return true;
+    }
+    Propose();
+    return false;
+}
+
+double BayesOpt::LengthScale() {
+    return lengthScales[model];
+}
+
+// Best error so far, once Update has set it
+double BayesOpt::Incumbent() {
+    return best_error;
+}
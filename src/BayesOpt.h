@@ -0,0 +1,160 @@
+//
+//  BayesOpt.h
+//  PID
+//
+// Bayesian optimization of the PID gains. A Gaussian process fitted to
+// the log error of every lap driven so far predicts the error of
+// untried gains, and the next lap drives the gains with the largest
+// expected improvement over the best error. It has the Twiddle
+// interface: evaluate p, store the result in error and call Update.
+//
+
+#ifndef BayesOpt_h
+#define BayesOpt_h
+
+#include <random>
+#include <vector>
+
+class BayesOpt {
+    // search box of each gain
+    std::vector<double> lower;
+    std::vector<double> upper;
+    
+    // gains scored so far in unit cube coordinates, p_num per row
+    std::vector<double> X;
+    
+    // their errors
+    std::vector<double> errors;
+    
+    // Cholesky factor of the kernel matrix for each length scale, row i
+    // holds i+1 entries starting at i*(i+1)/2
+    std::vector<std::vector<double>> factors;
+    
+    // length scale with the largest marginal likelihood, its factor
+    // and K^-1 (y - mean)/scale for the current targets
+    int model;
+    const double *L;
+    std::vector<double> alpha;
+    
+    // target mean and scale
+    double yMean;
+    double yScale;
+    
+    // random candidates
+    std::mt19937 generator;
+    
+    /*
+     * Map gains to and from the unit cube, in log space for positive ranges
+     */
+    void ToUnit(const double *p, double *u);
+    void FromUnit(const double *u, double *p);
+    
+    /*
+     * Squared exponential kernel
+     */
+    double Kernel(const double *a, const double *b, double lengthScale);
+    
+    /*
+     * Add a row to each Cholesky factor for the new point u
+     */
+    void Extend(const double *u);
+    
+    /*
+     * Recompute the targets, choose the length scale and compute alpha
+     * after an error is added
+     */
+    void Fit();
+    
+    /*
+     * Solve L x = b and L^T x = b in place
+     */
+    static void ForwardSolve(const double *L, double *b, int n);
+    static void BackSolve(const double *L, double *b, int n);
+    
+    /*
+     * Posterior mean and standard deviation of the target at u
+     */
+    void Predict(const double *u, double &mean, double &sd);
+    
+    /*
+     * Expected improvement of u over the best target
+     */
+    double ExpectedImprovement(const double *u, double best);
+    
+    /*
+     * Set p to the candidate with the largest expected improvement
+     */
+    void Propose();
+    
+public:
+    // number of parameters
+    int p_num;
+    
+    // gains to evaluate next, the best gains once done
+    double *p;
+    
+    // error of the gains in p
+    double error;
+    
+    // best error and gains
+    double best_error;
+    std::vector<double> best;
+    
+    // random gains scored before the model is used
+    int initialSamples;
+    
+    // number of laps to drive
+    int maxEvaluations;
+    
+    // candidate kernel length scales in unit cube coordinates and the
+    // noise variance
+    std::vector<double> lengthScales;
+    double noise;
+    
+    // targets more than this above the best log error are clipped so
+    // failed laps do not swamp the model
+    double clip;
+    
+    // random candidates per proposal, and how many of them are drawn
+    // around the best gains
+    int candidates;
+    int localCandidates;
+    
+    // laps scored
+    int count;
+    
+    /*
+     * Constructor
+     */
+    BayesOpt(unsigned seed = 1);
+    
+    /*
+     * Destructor.
+     */
+    virtual ~BayesOpt();
+    
+    /*
+     * Initialize with starting gains p, which are scored first, and the
+     * search box. Set lengthScales before Init to change them.
+     */
+    void Init(double *p, const double *lower, const double *upper, int p_num, int maxEvaluations);
+    
+    /*
+     * Add the error of the gains in p to the model and set p to the
+     * next gains. Returns true when maxEvaluations laps have been
+     * scored, with p set to the best gains.
+     */
+    bool Update();
+    
+    /*
+     * Length scale of the model in use
+     */
+    double LengthScale();
+    
+    /*
+     * Error a new lap has to beat, HUGE_VAL before the first error
+     */
+    double Incumbent();
+};
+
+#endif /* BayesOpt_h */
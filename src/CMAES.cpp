@@ -0,0 +1,250 @@
+//
+//  CMAES.cpp
+//  pid
+//
+// Class CMAES
+// Follows the (mu/mu_w, lambda)-CMA-ES of Hansen's tutorial. The
+// search runs on gains divided by scale so every coordinate starts
+// with unit spread, and C is decomposed every generation with Jacobi
+// rotations, which is cheap for the six gains of the two controllers.
+//
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include "CMAES.h"
+#include "Evaluator.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Jacobi sweeps before giving up on the eigen decomposition
+static const int maxSweeps = 50;
+
+CMAES::CMAES(unsigned seed): lambda(0), mu(0), mueff(0.), sigma(1.), generation(0), runBest(HUGE_VAL), improved(0),
+    generator(seed), p_num(0), p(nullptr), tolerance(1.e-3), stallTolerance(1.e-4), maxRestarts(4), maxGenerations(200), maxEvaluations(20000),
+    best_error(HUGE_VAL), evaluations(0), restarts(0), generations(0) {};
+
+CMAES::~CMAES() {};
+
+void CMAES::Init(double *p, const double *scale, int p_num, double tolerance) {
+    this->p = p;
+    this->p_num = p_num;
+    this->scale.assign(scale, scale + p_num);
+    this->tolerance = tolerance;
+    best_error = HUGE_VAL;
+    evaluations = 0;
+    restarts = 0;
+    generations = 0;
+    Start(4 + int(3*log(double(p_num))));
+}
+
+void CMAES::Start(int lambda) {
+    int n = p_num;
+    this->lambda = lambda;
+    mu = lambda/2;
+    weights.resize(mu);
+    double sum = 0.;
+    for(int i=0; i<mu; i++) {
+        weights[i] = log(mu + 0.5) - log(i + 1.);
+        sum += weights[i];
+    }
+    double sumSquares = 0.;
+    for(int i=0; i<mu; i++) {
+        weights[i] /= sum;
+        sumSquares += weights[i]*weights[i];
+    }
+    mueff = 1./sumSquares;
+    
+    cc = (4. + mueff/n)/(n + 4. + 2.*mueff/n);
+    cs = (mueff + 2.)/(n + mueff + 5.);
+    c1 = 2./((n + 1.3)*(n + 1.3) + mueff);
+    cmu = fmin(1. - c1, 2.*(mueff - 2. + 1./mueff)/((n + 2.)*(n + 2.) + mueff));
+    damps = 1. + 2.*fmax(0., sqrt((mueff - 1.)/(n + 1.)) - 1.) + cs;
+    chiN = sqrt(double(n))*(1. - 1./(4.*n) + 1./(21.*n*n));
+    
+    // unit spread around the best gains
+    mean.resize(n);
+    for(int j=0; j<n; j++)
+        mean[j] = p[j]/scale[j];
+    sigma = 1.;
+    ps.assign(n, 0.);
+    pc.assign(n, 0.);
+    C.assign(n*n, 0.);
+    B.assign(n*n, 0.);
+    D.assign(n, 1.);
+    for(int j=0; j<n; j++) {
+        C[j*n + j] = 1.;
+        B[j*n + j] = 1.;
+    }
+    generation = 0;
+    runBest = HUGE_VAL;
+    improved = 0;
+}
+
+// Cyclic Jacobi rotations; the columns of B are the eigenvectors and
+// D holds the square roots of the eigenvalues
+void CMAES::Decompose() {
+    int n = p_num;
+    vector<double> A = C;
+    for(int i=0; i<n; i++)
+        for(int j=0; j<n; j++)
+            B[i*n + j] = (i == j) ? 1. : 0.;
+    
+    for(int sweep=0; sweep<maxSweeps; sweep++) {
+        double off = 0.;
+        for(int i=0; i<n; i++)
+            for(int j=i+1; j<n; j++)
+                off += A[i*n + j]*A[i*n + j];
+        if(off < 1.e-30)
+            break;
+        for(int k=0; k<n; k++) {
+            for(int l=k+1; l<n; l++) {
+                double akl = A[k*n + l];
+                if(fabs(akl) < 1.e-300)
+                    continue;
+                double theta = (A[l*n + l] - A[k*n + k])/(2.*akl);
+                double t = (theta >= 0. ? 1. : -1.)/(fabs(theta) + sqrt(theta*theta + 1.));
+                double c = 1./sqrt(t*t + 1.);
+                double s = t*c;
+                for(int i=0; i<n; i++) {
+                    double aik = A[i*n + k];
+                    double ail = A[i*n + l];
+                    A[i*n + k] = c*aik - s*ail;
+                    A[i*n + l] = s*aik + c*ail;
+                }
+                for(int j=0; j<n; j++) {
+                    double akj = A[k*n + j];
+                    double alj = A[l*n + j];
+                    A[k*n + j] = c*akj - s*alj;
+                    A[l*n + j] = s*akj + c*alj;
+                }
+                for(int i=0; i<n; i++) {
+                    double bik = B[i*n + k];
+                    double bil = B[i*n + l];
+                    B[i*n + k] = c*bik - s*bil;
+                    B[i*n + l] = s*bik + c*bil;
+                }
+            }
+        }
+    }
+    for(int j=0; j<n; j++)
+        D[j] = sqrt(fmax(A[j*n + j], 1.e-20));
+}
+
+bool CMAES::Generation(GainEvaluator &evaluator, ThreadPool &pool) {
+    int n = p_num;
+    
+    // Sample x_k = mean + sigma*B*D*z_k
+    normal_distribution<double> normal(0., 1.);
+    vector<double> x(lambda*n);
+    vector<double> gains(lambda*n);
+    for(int k=0; k<lambda; k++) {
+        vector<double> z(n);
+        for(int j=0; j<n; j++)
+            z[j] = D[j]*normal(generator);
+        for(int i=0; i<n; i++) {
+            double y = 0.;
+            for(int j=0; j<n; j++)
+                y += B[i*n + j]*z[j];
+            x[k*n + i] = mean[i] + sigma*y;
+            gains[k*n + i] = x[k*n + i]*scale[i];
+        }
+    }
+    
+    // Score the population in parallel
+    vector<double> errors(lambda);
+    pool.ParallelFor(lambda, [&](int k) {
+        errors[k] = evaluator.Evaluate(&gains[k*n]);
+    });
+    evaluations += lambda;
+    generation++;
+    generations++;
+    
+    vector<int> order(lambda);
+    for(int k=0; k<lambda; k++)
+        order[k] = k;
+    sort(order.begin(), order.end(), [&](int a, int b) { return errors[a] < errors[b]; });
+    if(errors[order[0]] < runBest*(1. - stallTolerance)) {
+        runBest = errors[order[0]];
+        improved = generation;
+    }
+    if(errors[order[0]] < best_error) {
+        best_error = errors[order[0]];
+        for(int j=0; j<n; j++)
+            p[j] = gains[order[0]*n + j];
+    }
+    
+    // Recombine the best mu
+    vector<double> old = mean;
+    for(int j=0; j<n; j++) {
+        mean[j] = 0.;
+        for(int i=0; i<mu; i++)
+            mean[j] += weights[i]*x[order[i]*n + j];
+    }
+    vector<double> step(n);
+    for(int j=0; j<n; j++)
+        step[j] = (mean[j] - old[j])/sigma;
+    
+    // Step size path uses C^-1/2 step = B D^-1 B^T step
+    vector<double> t(n, 0.);
+    for(int j=0; j<n; j++) {
+        for(int i=0; i<n; i++)
+            t[j] += B[i*n + j]*step[i];
+        t[j] /= D[j];
+    }
+    double norm = 0.;
+    for(int i=0; i<n; i++) {
+        double w = 0.;
+        for(int j=0; j<n; j++)
+            w += B[i*n + j]*t[j];
+        ps[i] = (1. - cs)*ps[i] + sqrt(cs*(2. - cs)*mueff)*w;
+        norm += ps[i]*ps[i];
+    }
+    norm = sqrt(norm);
+    bool hsig = norm/sqrt(1. - pow(1. - cs, 2.*generation))/chiN < 1.4 + 2./(n + 1.);
+    for(int i=0; i<n; i++)
+        pc[i] = (1. - cc)*pc[i] + (hsig ? sqrt(cc*(2. - cc)*mueff) : 0.)*step[i];
+    
+    // Rank one and rank mu covariance update
+    for(int i=0; i<n; i++) {
+        for(int j=0; j<=i; j++) {
+            double rankMu = 0.;
+            for(int k=0; k<mu; k++) {
+                const double *xk = &x[order[k]*n];
+                rankMu += weights[k]*(xk[i] - old[i])*(xk[j] - old[j]);
+            }
+            rankMu /= sigma*sigma;
+            double c = (1. - c1 - cmu)*C[i*n + j]
+                     + c1*(pc[i]*pc[j] + (hsig ? 0. : cc*(2. - cc)*C[i*n + j]))
+                     + cmu*rankMu;
+            C[i*n + j] = c;
+            C[j*n + i] = c;
+        }
+    }
+    sigma *= exp((cs/damps)*(norm/chiN - 1.));
+    Decompose();
+    
+    // Converged when the largest axis is below tolerance, stalled when
+    // the population scores are flat, the run's best has not moved for
+    // a while or the run is too long
+    double maxD = *max_element(D.begin(), D.end());
+    bool flat = errors[order[lambda-1]] - errors[order[0]] <= 1.e-12*fabs(errors[order[0]]);
+    bool stalled = generation - improved > 10 + 30*n/lambda;
+    return sigma*maxD < tolerance || flat || stalled || generation >= maxGenerations;
+}
+
+double CMAES::Run(GainEvaluator &evaluator, ThreadPool &pool) {
+    while(true) {
+        printf("Run %d: population %d\n", restarts, lambda);
+        while(!Generation(evaluator, pool)) {
+            if(evaluations >= maxEvaluations)
+                return best_error;
+        }
+        printf("  %d generations, best error %10.3e, step %9.3e\n", generation, best_error, sigma);
+        if(restarts >= maxRestarts || evaluations >= maxEvaluations)
+            return best_error;
+        restarts++;
+        Start(2*lambda);
+    }
+}
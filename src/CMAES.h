@@ -0,0 +1,128 @@
+//
+//  CMAES.h
+//  PID
+//
+// Covariance matrix adaptation evolution strategy. Each generation
+// samples a population of gain sets from a multivariate normal,
+// scores them in parallel and moves the mean, step size and covariance
+// toward the best half. Because the covariance is learned, coupled
+// gains (steer and throttle together) are searched along their joint
+// directions instead of one gain at a time. When a run stalls it is
+// restarted from the best gains with twice the population (IPOP).
+//
+
+#ifndef CMAES_h
+#define CMAES_h
+
+#include <random>
+#include <vector>
+
+class GainEvaluator;
+class ThreadPool;
+
+class CMAES {
+    // population size, parents and recombination weights
+    int lambda;
+    int mu;
+    std::vector<double> weights;
+    double mueff;
+    
+    // learning rates and damping
+    double cc;
+    double cs;
+    double c1;
+    double cmu;
+    double damps;
+    double chiN;
+    
+    // distribution mean, step size and evolution paths, in units of scale
+    std::vector<double> mean;
+    double sigma;
+    std::vector<double> ps;
+    std::vector<double> pc;
+    
+    // covariance C = B diag(D^2) B^T, row major
+    std::vector<double> C;
+    std::vector<double> B;
+    std::vector<double> D;
+    
+    // generations in the current run, best error of the run and the
+    // generation it last improved by more than stallTolerance
+    int generation;
+    double runBest;
+    int improved;
+    
+    // normal samples
+    std::mt19937 generator;
+    
+    /*
+     * Set the strategy parameters for population size lambda and
+     * restart the distribution at the best gains
+     */
+    void Start(int lambda);
+    
+    /*
+     * Eigen decomposition of C into B and D
+     */
+    void Decompose();
+    
+public:
+    // number of parameters
+    int p_num;
+    
+    // best gains found, updated in place
+    double *p;
+    
+    // initial standard deviation of each gain
+    std::vector<double> scale;
+    
+    // run stops when the step size times the largest axis drops below
+    // tolerance (in units of scale)
+    double tolerance;
+    
+    // run stalls when its best error has not improved by this relative
+    // amount for 10 + 30*p_num/lambda generations
+    double stallTolerance;
+    
+    // limits
+    int maxRestarts;
+    int maxGenerations;
+    long maxEvaluations;
+    
+    // best error, evaluations, restarts and generations run
+    double best_error;
+    long evaluations;
+    int restarts;
+    int generations;
+    
+    /*
+     * Constructor
+     */
+    CMAES(unsigned seed = 1);
+    
+    /*
+     * Destructor.
+     */
+    virtual ~CMAES();
+    
+    /*
+     * Initialize with starting gains p and their initial standard
+     * deviations
+     */
+    void Init(double *p, const double *scale, int p_num, double tolerance);
+    
+    /*
+     * Sample, score and update one generation. Returns true when the
+     * current run has converged or stalled.
+     */
+    bool Generation(GainEvaluator &evaluator, ThreadPool &pool);
+    
+    /*
+     * Run generations, restarting with a doubled population when a
+     * run converges, until maxRestarts or maxEvaluations is reached.
+     * Returns best_error.
+     */
+    double Run(GainEvaluator &evaluator, ThreadPool &pool);
+};
+
+#endif /* CMAES_h */
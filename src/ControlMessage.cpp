@@ -0,0 +1,382 @@
+//
+//  ControlMessage.cpp
+//  pid
+//
+// Class ControlEncoder
+// This class formats the steering and throttle values into the
+// Socket.IO steer event expected by the simulator. Numbers are
+// written with the Grisu2 algorithm (Loitsch, "Printing Floating-Point
+// Numbers Quickly and Accurately with Integers"), which gives the
+// shortest digit string that reads back as the same double. The
+// layout follows the %.15g formatting used by json::dump, so the
+// output is identical to it only when 15 digits already round trip;
+// otherwise it has the extra digits json::dump drops.
+//
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "ControlMessage.h"
+
+using namespace std;
+
+// Fixed text of the steer event. The keys are in the order
+// json::dump writes them (alphabetical).
+static const char steerPrefix[] = "42[\"steer\",{\"steering_angle\":";
+static const char throttleKey[] = ",\"throttle\":";
+static const char steerSuffix[] = "}]";
+
+// Digits json::dump writes (%.15g)
+static const int jsonDigits = 15;
+
+/*
+ * Floating point number f * 2^e with a 64 bit significand
+ */
+struct DiyFp {
+    uint64_t f;
+    int e;
+};
+
+// x - y, both with the same exponent
+static DiyFp Sub(DiyFp x, DiyFp y) {
+    DiyFp r = {x.f - y.f, x.e};
+    return r;
+}
+
+// x * y rounded to the upper 64 bits of the product
+static DiyFp Mul(DiyFp x, DiyFp y) {
+    const uint64_t u_lo = x.f & 0xFFFFFFFFu;
+    const uint64_t u_hi = x.f >> 32;
+    const uint64_t v_lo = y.f & 0xFFFFFFFFu;
+    const uint64_t v_hi = y.f >> 32;
+
+    const uint64_t p0 = u_lo * v_lo;
+    const uint64_t p1 = u_lo * v_hi;
+    const uint64_t p2 = u_hi * v_lo;
+    const uint64_t p3 = u_hi * v_hi;
+
+    uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+    q += uint64_t(1) << 31; // round
+    DiyFp r = {p3 + (p1 >> 32) + (p2 >> 32) + (q >> 32), x.e + y.e + 64};
+    return r;
+}
+
+// Shift so the most significant bit of f is set
+static DiyFp Normalize(DiyFp x) {
+    while((x.f >> 63) == 0) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/*
+ * Cached powers of ten 10^k = f * 2^e for k = -300, -292, ..., 324
+ */
+static const int cachedPowersMinDecExp = -300;
+static const int cachedPowersDecStep = 8;
+static const int cachedPowersCount = 79;
+
+struct CachedPower {
+    uint64_t f;
+    int e;
+    int k;
+};
+
+struct CachedPowers {
+    CachedPower power[cachedPowersCount];
+    CachedPowers();
+};
+
+// Small fixed size big integer used only to build the cached power table
+struct BigNum {
+    static const int words = 48;
+    uint32_t w[words];
+
+    BigNum(int bit) {
+        memset(w, 0, sizeof(w));
+        w[bit/32] = uint32_t(1) << (bit%32);
+    }
+
+    void MulSmall(uint32_t m) {
+        uint64_t carry = 0;
+        for(int i=0; i<words; i++) {
+            uint64_t t = uint64_t(w[i])*m + carry;
+            w[i] = uint32_t(t);
+            carry = t >> 32;
+        }
+    }
+
+    void DivSmall(uint32_t d) {
+        uint64_t rem = 0;
+        for(int i=words-1; i>=0; i--) {
+            uint64_t t = (rem << 32) | w[i];
+            w[i] = uint32_t(t/d);
+            rem = t%d;
+        }
+    }
+
+    int BitLength() const {
+        for(int i=words-1; i>=0; i--)
+            if(w[i])
+                return 32*i + 32 - __builtin_clz(w[i]);
+        return 0;
+    }
+
+    bool Bit(int b) const {
+        return b >= 0 && ((w[b/32] >> (b%32)) & 1);
+    }
+
+    // Top 64 bits, rounded to nearest
+    uint64_t Top64(int length) const {
+        uint64_t f = 0;
+        for(int b=length-1; b>=length-64; b--)
+            f = (f << 1) | (Bit(b) ? 1 : 0);
+        if(Bit(length-65))
+            f++;
+        return f;
+    }
+};
+
+// Build the table exactly. Positive powers are computed as integers and
+// negative powers as 2^1280 / 10^|k|, leaving well over 64 bits of
+// quotient for the smallest power in the table.
+CachedPowers::CachedPowers() {
+    const int fixedPoint = 1280;
+    for(int i=0; i<cachedPowersCount; i++) {
+        int k = cachedPowersMinDecExp + cachedPowersDecStep*i;
+        BigNum x(k >= 0 ? 0 : fixedPoint);
+        for(int j=0; j<abs(k); j++) {
+            if(k >= 0)
+                x.MulSmall(10);
+            else
+                x.DivSmall(10);
+        }
+        int length = x.BitLength();
+        uint64_t f = x.Top64(length);
+        int e = length - 64 - (k >= 0 ? 0 : fixedPoint);
+        if(f == 0) {
+            // rounding carried out of the top bit
+            f = uint64_t(1) << 63;
+            e++;
+        }
+        power[i].f = f;
+        power[i].e = e;
+        power[i].k = k;
+    }
+}
+
+// Cached power c = 10^k such that the product with a number with
+// binary exponent e has its exponent in [-60, -32]
+static const int minProductExponent = -60;
+
+static CachedPower GetCachedPower(int e) {
+    static const CachedPowers table;
+    const int f = minProductExponent - e - 1;
+    const int k = (f*78913)/(1 << 18) + (f > 0 ? 1 : 0);
+    const int index = (-cachedPowersMinDecExp + k + (cachedPowersDecStep - 1))/cachedPowersDecStep;
+    return table.power[index];
+}
+
+// Largest power of ten <= n, returns the number of digits of n
+static int LargestPow10(uint32_t n, uint32_t &pow10) {
+    static const uint32_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000,
+                                      10000000, 100000000, 1000000000};
+    int k = 10;
+    while(k > 1 && n < powers[k-1])
+        k--;
+    pow10 = powers[k-1];
+    return k;
+}
+
+// Move the last digit toward w while it stays inside the
+// rounding interval
+static void Round(char *buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t tenK) {
+    while(rest < dist && delta - rest >= tenK &&
+          (rest + tenK < dist || dist - rest > rest + tenK - dist)) {
+        buf[len-1]--;
+        rest += tenK;
+    }
+}
+
+// Generate the digits of w = v * 10^-k inside (mMinus, mPlus)
+static void DigitGen(char *buffer, int &length, int &decimalExponent, DiyFp mMinus, DiyFp w, DiyFp mPlus) {
+    const DiyFp one = {uint64_t(1) << -mPlus.e, mPlus.e};
+    uint32_t p1 = uint32_t(mPlus.f >> -one.e);
+    uint64_t p2 = mPlus.f & (one.f - 1);
+    uint64_t delta = Sub(mPlus, mMinus).f;
+    uint64_t dist = Sub(mPlus, w).f;
+
+    // integral part
+    uint32_t pow10;
+    int n = LargestPow10(p1, pow10);
+    while(n > 0) {
+        const uint32_t d = p1/pow10;
+        p1 %= pow10;
+        buffer[length++] = char('0' + d);
+        n--;
+        const uint64_t rest = (uint64_t(p1) << -one.e) + p2;
+        if(rest <= delta) {
+            decimalExponent += n;
+            Round(buffer, length, dist, delta, rest, uint64_t(pow10) << -one.e);
+            return;
+        }
+        pow10 /= 10;
+    }
+
+    // fractional part
+    int m = 0;
+    while(true) {
+        p2 *= 10;
+        const uint64_t d = p2 >> -one.e;
+        p2 &= one.f - 1;
+        buffer[length++] = char('0' + d);
+        m++;
+        delta *= 10;
+        dist *= 10;
+        if(p2 <= delta)
+            break;
+    }
+    decimalExponent -= m;
+    Round(buffer, length, dist, delta, p2, one.f);
+}
+
+// Shortest digits of a positive finite double. Returns the digits in
+// buffer and the exponent so that value = digits * 10^decimalExponent.
+static int Grisu2(char *buffer, int &decimalExponent, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint64_t hiddenBit = uint64_t(1) << 52;
+    const int bias = 1023 + 52;
+    const uint64_t E = bits >> 52;
+    const uint64_t F = bits & (hiddenBit - 1);
+
+    DiyFp v;
+    if(E == 0) {
+        v.f = F;
+        v.e = 1 - bias;
+    } else {
+        v.f = F + hiddenBit;
+        v.e = int(E) - bias;
+    }
+
+    // boundaries of the rounding interval of v
+    DiyFp mPlus = {2*v.f + 1, v.e - 1};
+    DiyFp mMinus;
+    if(F == 0 && E > 1) {
+        mMinus.f = 4*v.f - 1;
+        mMinus.e = v.e - 2;
+    } else {
+        mMinus.f = 2*v.f - 1;
+        mMinus.e = v.e - 1;
+    }
+    mPlus = Normalize(mPlus);
+    mMinus.f <<= mMinus.e - mPlus.e;
+    mMinus.e = mPlus.e;
+    v = Normalize(v);
+
+    const CachedPower cached = GetCachedPower(mPlus.e);
+    const DiyFp c = {cached.f, cached.e};
+    const DiyFp w = Mul(v, c);
+    DiyFp wMinus = Mul(mMinus, c);
+    DiyFp wPlus = Mul(mPlus, c);
+    wMinus.f += 1;
+    wPlus.f -= 1;
+
+    int length = 0;
+    decimalExponent = -cached.k;
+    DigitGen(buffer, length, decimalExponent, wMinus, w, wPlus);
+    return length;
+}
+
+ControlEncoder::ControlEncoder(): length(0) {
+    buffer[0] = '\0';
+};
+
+ControlEncoder::~ControlEncoder() {};
+
+// Format the steer event into buffer
+size_t ControlEncoder::Encode(double steerValue, double throttleValue) {
+    char *out = buffer;
+    memcpy(out, steerPrefix, sizeof(steerPrefix) - 1);
+    out += sizeof(steerPrefix) - 1;
+    out += WriteNumber(out, steerValue);
+    memcpy(out, throttleKey, sizeof(throttleKey) - 1);
+    out += sizeof(throttleKey) - 1;
+    out += WriteNumber(out, throttleValue);
+    memcpy(out, steerSuffix, sizeof(steerSuffix));
+    out += sizeof(steerSuffix) - 1;
+    length = out - buffer;
+    return length;
+}
+
+// Format a double. json.hpp writes null for values that are not
+// finite, uses %.15g otherwise and appends ".0" to integer looking
+// output. The same layout is used here with the Grisu2 digits.
+size_t ControlEncoder::WriteNumber(char *out, double x) {
+    if(!isfinite(x)) {
+        memcpy(out, "null", 4);
+        return 4;
+    }
+
+    size_t i = 0;
+    if(signbit(x)) {
+        out[i++] = '-';
+        x = -x;
+    }
+
+    // special case for 0.0 and -0.0
+    if(x == 0) {
+        memcpy(out + i, "0.0", 3);
+        return i + 3;
+    }
+
+    char digits[20];
+    int decimalExponent;
+    int n = Grisu2(digits, decimalExponent, x);
+
+    // %g switches to scientific notation when the exponent is
+    // below -4 or at least the precision
+    int point = n + decimalExponent;
+    int precision = n > jsonDigits ? n : jsonDigits;
+    int exponent = point - 1;
+    if(exponent < -4 || exponent >= precision) {
+        out[i++] = digits[0];
+        if(n > 1) {
+            out[i++] = '.';
+            memcpy(out + i, digits + 1, n - 1);
+            i += n - 1;
+        }
+        out[i++] = 'e';
+        out[i++] = exponent < 0 ? '-' : '+';
+        int a = exponent < 0 ? -exponent : exponent;
+        if(a >= 100)
+            out[i++] = char('0' + a/100);
+        out[i++] = char('0' + (a/10)%10);
+        out[i++] = char('0' + a%10);
+    } else if(point <= 0) {
+        // 0.000ddd
+        out[i++] = '0';
+        out[i++] = '.';
+        memset(out + i, '0', -point);
+        i += -point;
+        memcpy(out + i, digits, n);
+        i += n;
+    } else if(point < n) {
+        // dd.ddd
+        memcpy(out + i, digits, point);
+        i += point;
+        out[i++] = '.';
+        memcpy(out + i, digits + point, n - point);
+        i += n - point;
+    } else {
+        // ddd00.0
+        memcpy(out + i, digits, n);
+        i += n;
+        memset(out + i, '0', point - n);
+        i += point - n;
+        out[i++] = '.';
+        out[i++] = '0';
+    }
+    return i;
+}
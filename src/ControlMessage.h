@@ -0,0 +1,61 @@
+//
+//  ControlMessage.h
+//  PID
+//
+// Encoder for the steer event sent back to the simulator. The message
+// is formatted into a fixed buffer owned by the encoder so a reply
+// costs no heap allocation. The message is not byte for byte the one
+// json::dump writes: json::dump rounds to 15 digits and this encoder
+// writes the shortest digits that read back as the same double (up to
+// 17). Parsed with json.hpp, every message gives back exactly the
+// steering and throttle values encoded; bench-encoder checks that.
+//
+
+#ifndef ControlMessage_h
+#define ControlMessage_h
+
+#include <stddef.h>
+
+class ControlEncoder {
+public:
+    /*
+     * Size of the message buffer. Two doubles at 17 significant
+     * digits plus the fixed text fit with room to spare.
+     */
+    static const size_t bufferSize = 128;
+
+    /*
+     * Formatted message
+     */
+    char buffer[bufferSize];
+
+    /*
+     * Length of the formatted message
+     */
+    size_t length;
+
+    /*
+     * Constructor
+     */
+    ControlEncoder();
+
+    /*
+     * Destructor.
+     */
+    virtual ~ControlEncoder();
+
+    /*
+     * Format 42["steer",{"steering_angle":...,"throttle":...}] into
+     * buffer and return its length.
+     */
+    size_t Encode(double steerValue, double throttleValue);
+
+    /*
+     * Write the shortest digits that read back as x, in the %g layout
+     * json::dump uses, or null if x is not finite. Returns the number
+     * of characters written.
+     */
+    static size_t WriteNumber(char *out, double x);
+};
+
+#endif /* ControlMessage_h */
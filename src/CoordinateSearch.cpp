@@ -0,0 +1,137 @@
+//
+//  CoordinateSearch.cpp
+//  pid
+//
+// Class CoordinateSearch
+// The per gain searches drive oneDsearch exactly as main-oneDsearch.cpp
+// does (push an error, ask for the next parameter) but each one scores
+// its probes with its own copy of the gains, so they can share one
+// thread safe GainEvaluator and run on the pool together.
+//
+
+#include <math.h>
+#include "CoordinateSearch.h"
+#include "Evaluator.h"
+#include "ThreadPool.h"
+#include "oneDsearch.h"
+
+using namespace std;
+
+CoordinateSearch::CoordinateSearch(): tolerance(0.), p_num(0), p(nullptr), best_error(0.),
+    searchTolerance(0.01), lineTolerance(0.05), passes(0), change(0.) {};
+
+CoordinateSearch::~CoordinateSearch() {};
+
+void CoordinateSearch::Init(double *p, const double *lower, const double *upper, int p_num, double tolerance) {
+    this->p = p;
+    this->p_num = p_num;
+    this->tolerance = tolerance;
+    this->lower.assign(lower, lower + p_num);
+    this->upper.assign(upper, upper + p_num);
+    passes = 0;
+    change = 0.;
+}
+
+// Search gain i over its interval
+double CoordinateSearch::SearchGain(GainEvaluator &evaluator, int i, double &bestError) {
+    vector<double> q(p, p + p_num);
+    double a = lower[i];
+    double b = upper[i];
+    oneDsearch od;
+    od.Init(a, b, fabs(b-a)*searchTolerance);
+    
+    double bestGain = p[i];
+    bestError = best_error;
+    bool searchDone = false;
+    while(!searchDone) {
+        q[i] = od.paramUpdate();
+        double error = evaluator.Evaluate(&q[0]);
+        if(error < bestError) {
+            bestError = error;
+            bestGain = q[i];
+        }
+        searchDone = od.newError(error);
+    }
+    return bestGain;
+}
+
+// Search along the combined step
+double CoordinateSearch::LineSearch(GainEvaluator &evaluator, const vector<double> &step, vector<double> &best) {
+    vector<double> q(p_num);
+    best.assign(p, p + p_num);
+    double bestError = best_error;
+    oneDsearch od;
+    od.Init(0., 1., lineTolerance);
+    bool searchDone = false;
+    while(!searchDone) {
+        double t = od.paramUpdate();
+        for(int j=0; j<p_num; j++)
+            q[j] = p[j] + t*step[j];
+        double error = t == 0. ? best_error : evaluator.Evaluate(&q[0]);
+        if(error < bestError) {
+            bestError = error;
+            best = q;
+        }
+        searchDone = od.newError(error);
+    }
+    return bestError;
+}
+
+bool CoordinateSearch::Pass(GainEvaluator &evaluator, ThreadPool &pool) {
+    if(passes == 0)
+        best_error = evaluator.Evaluate(p);
+    passes++;
+    
+    // One golden section search per gain, all at once
+    vector<double> gains(p_num);
+    vector<double> errors(p_num);
+    pool.ParallelFor(p_num, [&](int i) {
+        gains[i] = SearchGain(evaluator, i, errors[i]);
+    });
+    
+    // Best single gain move
+    vector<double> best(p, p + p_num);
+    double bestError = best_error;
+    for(int i=0; i<p_num; i++) {
+        if(errors[i] < bestError) {
+            best.assign(p, p + p_num);
+            best[i] = gains[i];
+            bestError = errors[i];
+        }
+    }
+    
+    // Reconcile along the combined step if more than one gain moved
+    vector<double> step(p_num);
+    int numMoved = 0;
+    for(int i=0; i<p_num; i++) {
+        step[i] = gains[i] - p[i];
+        if(step[i] != 0.)
+            numMoved++;
+    }
+    if(numMoved > 1) {
+        vector<double> lineBest;
+        double lineError = LineSearch(evaluator, step, lineBest);
+        if(lineError < bestError) {
+            best = lineBest;
+            bestError = lineError;
+        }
+    }
+    
+    // Move and check how far the gains went
+    double sum = 0.;
+    for(int j=0; j<p_num; j++) {
+        double diff = best[j] - p[j];
+        sum += diff*diff;
+        p[j] = best[j];
+    }
+    best_error = bestError;
+    change = sqrt(sum);
+    return change < tolerance;
+}
+
+// Golden section probes never reach the ends exactly, so compare with
+// the width at which the per gain searches stop
+bool CoordinateSearch::AtBound(int i) {
+    double margin = (upper[i] - lower[i])*searchTolerance;
+    return p[i] <= lower[i] + margin || p[i] >= upper[i] - margin;
+}
@@ -0,0 +1,90 @@
+//
+//  CoordinateSearch.h
+//  PID
+//
+// Parallel coordinate search built on oneDsearch. Each pass runs one
+// golden section search per gain at the same time, every search
+// holding the other gains at their values from the start of the pass.
+// The per gain minima are then reconciled with a golden section line
+// search along the combined step, so a pass costs one search per gain
+// in wall time rather than one after the other.
+//
+
+#ifndef CoordinateSearch_h
+#define CoordinateSearch_h
+
+#include <vector>
+
+class GainEvaluator;
+class ThreadPool;
+
+class CoordinateSearch {
+    // stopping tolerance on the change in gains over a pass
+    double tolerance;
+    
+    // search interval of each gain
+    std::vector<double> lower;
+    std::vector<double> upper;
+    
+    /*
+     * Golden section search of gain i with the others fixed at p.
+     * Returns the best gain probed and its error.
+     */
+    double SearchGain(GainEvaluator &evaluator, int i, double &bestError);
+    
+    /*
+     * Golden section search of p + t*step for t in [0, 1].
+     * Writes the best point probed to best and returns its error.
+     */
+    double LineSearch(GainEvaluator &evaluator, const std::vector<double> &step, std::vector<double> &best);
+    
+public:
+    // number of parameters
+    int p_num;
+    
+    // parameters, updated in place after every pass
+    double *p;
+    
+    // error at p
+    double best_error;
+    
+    // relative width at which each golden section search stops
+    double searchTolerance;
+    double lineTolerance;
+    
+    // passes run
+    int passes;
+    
+    // change in gains over the last pass
+    double change;
+    
+    /*
+     * Constructor
+     */
+    CoordinateSearch();
+    
+    /*
+     * Destructor.
+     */
+    virtual ~CoordinateSearch();
+    
+    /*
+     * Initialize with parameters p and the search interval
+     * [lower[i], upper[i]] of each one.
+     */
+    void Init(double *p, const double *lower, const double *upper, int p_num, double tolerance);
+    
+    /*
+     * Run one pass. Returns true when the gains moved less than
+     * tolerance.
+     */
+    bool Pass(GainEvaluator &evaluator, ThreadPool &pool);
+    
+    /*
+     * True if gain i is within one search tolerance of an end of its
+     * interval, so the best gain may lie outside it
+     */
+    bool AtBound(int i);
+};
+
+#endif /* CoordinateSearch_h */
@@ -0,0 +1,68 @@
+//
+//  Episode.cpp
+//  pid
+//
+// Class EpisodeLog
+// Errors are normalized the way the drivers always reported them: the
+// square root of the accumulated squared error divided by the distance.
+//
+
+#include <math.h>
+#include "Episode.h"
+#include "Histogram.h"
+
+using namespace std;
+
+EpisodeLog::EpisodeLog(size_t capacity): startedAt(0), frames(0), maxCte(0.), running(false) {
+    episodes.reserve(capacity);
+};
+
+EpisodeLog::~EpisodeLog() {};
+
+void EpisodeLog::Begin() {
+    startedAt = LatencyStats::Now();
+    frames = 0;
+    maxCte = 0.;
+    running = true;
+}
+
+const EpisodeSummary &EpisodeLog::End(EpisodeEnd end, double distance, double steerAccumulated, double throttleAccumulated) {
+    EpisodeSummary summary;
+    summary.index = int(episodes.size());
+    summary.frames = frames;
+    summary.seconds = running ? (LatencyStats::Now() - startedAt)*1.e-9 : 0.;
+    summary.distance = distance;
+    summary.maxCte = maxCte;
+    summary.steerError = distance > 0. ? sqrt(steerAccumulated)/distance : HUGE_VAL;
+    summary.throttleError = distance > 0. ? sqrt(throttleAccumulated)/distance : HUGE_VAL;
+    summary.end = end;
+    episodes.push_back(summary);
+    running = false;
+    return episodes.back();
+}
+
+const char *EpisodeLog::Name(EpisodeEnd end) {
+    static const char *names[3] = {"completed", "off-track", "stopped"};
+    return names[end];
+}
+
+void EpisodeLog::Dump(FILE *out) {
+    fprintf(out, "%7s %9s %7s %8s %7s %12s %12s  %s\n", "episode", "end", "frames", "seconds", "miles", "steer error",
+            "speed error", "max cte");
+    double steerSum = 0.;
+    double throttleSum = 0.;
+    int completed = 0;
+    for(const EpisodeSummary &e : episodes) {
+        fprintf(out, "%7d %9s %7d %8.1f %7.3f %12.4e %12.4e  %.3f\n", e.index, Name(e.end), e.frames, e.seconds,
+                e.distance, e.steerError, e.throttleError, e.maxCte);
+        if(e.end == EpisodeCompleted) {
+            steerSum += e.steerError;
+            throttleSum += e.throttleError;
+            completed++;
+        }
+    }
+    if(completed > 0)
+        fprintf(out, "%d of %zu episodes completed, mean steer error %.4e, mean speed error %.4e\n", completed,
+                episodes.size(), steerSum/completed, throttleSum/completed);
+    fflush(out);
+}
@@ -0,0 +1,106 @@
+//
+//  Episode.h
+//  PID
+//
+// Episode lifecycle of a simulator connection. A driver calls Begin
+// when it starts the controllers on a fresh lap, Frame on every frame
+// and End when the lap is over, then resets its controllers and sends
+// the simulator a reset instead of exiting. The summaries of all
+// episodes stay in memory so a batch of laps can run back to back on
+// one connection and be reported at the end.
+//
+
+#ifndef Episode_h
+#define Episode_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+enum EpisodeEnd {EpisodeCompleted, EpisodeOffTrack, EpisodeStopped};
+
+/*
+ * Summary of one finished episode
+ */
+struct EpisodeSummary {
+    // episode number on this connection
+    int index;
+    
+    // frames driven and wall time (seconds)
+    int frames;
+    double seconds;
+    
+    // distance traveled (miles)
+    double distance;
+    
+    // largest |cte| seen
+    double maxCte;
+    
+    // steering and speed errors, sqrt of the accumulated error over distance
+    double steerError;
+    double throttleError;
+    
+    // why the episode ended
+    EpisodeEnd end;
+};
+
+class EpisodeLog {
+    // start of the current episode (ns)
+    uint64_t startedAt;
+    
+    // frames and largest |cte| of the current episode
+    int frames;
+    double maxCte;
+    
+public:
+    // finished episodes, oldest first
+    std::vector<EpisodeSummary> episodes;
+    
+    // true between Begin and End
+    bool running;
+    
+    /*
+     * Constructor. Room for capacity summaries is reserved up front so
+     * ending an episode does not allocate until that many have run.
+     */
+    EpisodeLog(size_t capacity = 256);
+    
+    /*
+     * Destructor.
+     */
+    virtual ~EpisodeLog();
+    
+    /*
+     * Start a new episode
+     */
+    void Begin();
+    
+    /*
+     * Count a frame of the current episode
+     */
+    void Frame(double cte) {
+        frames++;
+        if(cte > maxCte)
+            maxCte = cte;
+        else if(-cte > maxCte)
+            maxCte = -cte;
+    }
+    
+    /*
+     * Finish the current episode from the accumulated PID errors and
+     * distance, and return its summary
+     */
+    const EpisodeSummary &End(EpisodeEnd end, double distance, double steerAccumulated, double throttleAccumulated);
+    
+    /*
+     * Name of an episode end
+     */
+    static const char *Name(EpisodeEnd end);
+    
+    /*
+     * Print one line per episode and the mean errors of completed ones
+     */
+    void Dump(FILE *out);
+};
+
+#endif /* Episode_h */
@@ -0,0 +1,124 @@
+//
+//  EvaluationCache.cpp
+//  pid
+//
+// Classes EvaluationCache and CachedEvaluator
+// The cache file holds one entry per line:
+//   scenario <tab> g0,g1,... <tab> error
+// Entries of other scenarios are skipped on load and left in place, so
+// one file can serve several tuning runs.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "EvaluationCache.h"
+
+using namespace std;
+
+// Longest line read from a cache file
+static const size_t maxLine = 1024;
+
+EvaluationCache::EvaluationCache(const string &scenario): scenario(scenario), file(nullptr), hits(0), misses(0) {};
+
+EvaluationCache::~EvaluationCache() {
+    if(file != nullptr)
+        fclose(file);
+};
+
+string EvaluationCache::Key(const double *p, int p_num) {
+    string key = scenario + "\t";
+    char number[32];
+    for(int j=0; j<p_num; j++) {
+        snprintf(number, sizeof(number), j == 0 ? "%.9g" : ",%.9g", p[j]);
+        key += number;
+    }
+    return key;
+}
+
+int EvaluationCache::Open(const string &filename) {
+    lock_guard<std::mutex> lock(mutex);
+    int loaded = 0;
+    FILE *in = fopen(filename.c_str(), "r");
+    if(in != nullptr) {
+        char line[maxLine];
+        string prefix = scenario + "\t";
+        while(fgets(line, sizeof(line), in) != nullptr) {
+            char *tab = strrchr(line, '\t');
+            if(tab == nullptr || strncmp(line, prefix.c_str(), prefix.length()) != 0)
+                continue;
+            char *end;
+            double error = strtod(tab + 1, &end);
+            if(end == tab + 1)
+                continue;
+            errors[string(line, tab - line)] = error;
+            loaded++;
+        }
+        fclose(in);
+    }
+    if(file != nullptr)
+        fclose(file);
+    file = fopen(filename.c_str(), "a");
+    return file == nullptr ? -1 : loaded;
+}
+
+size_t EvaluationCache::Size() {
+    lock_guard<std::mutex> lock(mutex);
+    return errors.size();
+}
+
+bool EvaluationCache::Lookup(const double *p, int p_num, double &error) {
+    string key = Key(p, p_num);
+    lock_guard<std::mutex> lock(mutex);
+    auto found = errors.find(key);
+    if(found == errors.end()) {
+        misses++;
+        return false;
+    }
+    hits++;
+    error = found->second;
+    return true;
+}
+
+// Store and append to the file; flushed so nothing is lost if the run
+// is killed
+void EvaluationCache::Store(const double *p, int p_num, double error) {
+    string key = Key(p, p_num);
+    lock_guard<std::mutex> lock(mutex);
+    errors[key] = error;
+    if(file != nullptr) {
+        fprintf(file, "%s\t%.17g\n", key.c_str(), error);
+        fflush(file);
+    }
+}
+
+CachedEvaluator::CachedEvaluator(GainEvaluator &evaluator, EvaluationCache &cache): evaluator(evaluator), cache(cache) {};
+
+CachedEvaluator::~CachedEvaluator() {};
+
+int CachedEvaluator::NumParams() {
+    return evaluator.NumParams();
+}
+
+double CachedEvaluator::Evaluate(const double *p) {
+    double error;
+    if(cache.Lookup(p, NumParams(), error))
+        return error;
+    error = evaluator.Evaluate(p);
+    cache.Store(p, NumParams(), error);
+    return error;
+}
+
+double CachedEvaluator::Evaluate(const double *p, double distance) {
+    return evaluator.Evaluate(p, distance);
+}
+
+double CachedEvaluator::Evaluate(const double *p, double bound, bool &complete) {
+    double error;
+    complete = true;
+    if(cache.Lookup(p, NumParams(), error))
+        return error;
+    error = evaluator.Evaluate(p, bound, complete);
+    if(complete)
+        cache.Store(p, NumParams(), error);
+    return error;
+}
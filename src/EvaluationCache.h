@@ -0,0 +1,121 @@
+//
+//  EvaluationCache.h
+//  PID
+//
+// Memo of scored gain sets. Entries are keyed on a scenario id (track,
+// which gains, lap length, ...) and the gains rounded to nine
+// significant digits, so a probe that lands back on a point already
+// scored up to rounding noise (Twiddle's Backward step, golden section
+// interior points) is not driven again. Entries are appended to a text
+// file as they are scored, which lets an interrupted run resume.
+//
+
+#ifndef EvaluationCache_h
+#define EvaluationCache_h
+
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include "Evaluator.h"
+
+class EvaluationCache {
+    // scenario part of every key
+    std::string scenario;
+    
+    // scored entries by key
+    std::unordered_map<std::string, double> errors;
+    
+    // file entries are appended to, nullptr if not persisted
+    FILE *file;
+    
+    // guards errors, file and the counters
+    std::mutex mutex;
+    
+    /*
+     * Key for parameter vector p
+     */
+    std::string Key(const double *p, int p_num);
+    
+public:
+    // lookups answered from the cache and lookups that missed
+    long hits;
+    long misses;
+    
+    /*
+     * Constructor
+     */
+    EvaluationCache(const std::string &scenario);
+    
+    /*
+     * Destructor. Closes the file.
+     */
+    virtual ~EvaluationCache();
+    
+    /*
+     * Load the entries of a cache file and append new entries to it.
+     * Returns the number of entries loaded for this scenario, or -1 if
+     * the file cannot be opened for writing.
+     */
+    int Open(const std::string &filename);
+    
+    /*
+     * Number of entries for this scenario
+     */
+    size_t Size();
+    
+    /*
+     * Look up the error of p. Returns false if it has not been scored.
+     */
+    bool Lookup(const double *p, int p_num, double &error);
+    
+    /*
+     * Store the error of p
+     */
+    void Store(const double *p, int p_num, double error);
+};
+
+/*
+ * Evaluator that answers from an EvaluationCache and scores misses
+ * with another evaluator. Safe to share between threads if the
+ * wrapped evaluator is.
+ */
+class CachedEvaluator : public GainEvaluator {
+    GainEvaluator &evaluator;
+    EvaluationCache &cache;
+    
+public:
+    /*
+     * Constructor
+     */
+    CachedEvaluator(GainEvaluator &evaluator, EvaluationCache &cache);
+    
+    /*
+     * Destructor.
+     */
+    virtual ~CachedEvaluator();
+    
+    /*
+     * Same as the wrapped evaluator
+     */
+    int NumParams();
+    
+    /*
+     * Cached error of p, scoring it on a miss
+     */
+    double Evaluate(const double *p);
+    
+    /*
+     * Error of p over a lap of the given length, not cached since
+     * the scenario fixes the lap length
+     */
+    double Evaluate(const double *p, double distance);
+    
+    /*
+     * Cached error of p, scoring it on a miss. Runs stopped early are
+     * not stored.
+     */
+    double Evaluate(const double *p, double bound, bool &complete);
+};
+
+#endif /* EvaluationCache_h */
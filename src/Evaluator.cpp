@@ -0,0 +1,158 @@
+//
+//  Evaluator.cpp
+//  pid
+//
+// Class PlantEvaluator
+// This class runs the same control loop as main-twiddle.cpp against
+// the offline plant. Each frame the plant is sensed, the PID
+// controllers produce steering and throttle values and the plant is
+// stepped. The run stops on distance or cte like the simulator runs
+// and the error is normalized with Twiddle::NormalizeError.
+//
+
+#include <math.h>
+#include "Evaluator.h"
+#include "PID.h"
+#include "Twiddle.h"
+
+using namespace std;
+
+GainEvaluator::~GainEvaluator() {};
+
+double GainEvaluator::Evaluate(const double *p, double distance) {
+    return Evaluate(p);
+}
+
+double GainEvaluator::Evaluate(const double *p, double bound, bool &complete) {
+    complete = true;
+    return Evaluate(p);
+}
+
+PlantEvaluator::PlantEvaluator(const Track &track, GainTarget target): track(track), target(target),
+    steerGains{0.2113, 0.0026, 21.5840}, throttleGains{0.1000, 0.0001, -0.0274},
+    steerBounds{-1., 1.}, throttleBounds{-1., 1.}, setCte(0.), setSpeed(35.),
+    nSteps(100), maxDistance(1.), cteMax(2.), maxSteps(100000), throttleWeight(0.001),
+    startCte(0.7598), startSpeed(0.), pruneFraction(HUGE_VAL), pruneSlack(2.), plant(track), evaluations(0), pruned(0), steps(0) {};
+
+PlantEvaluator::~PlantEvaluator() {};
+
+int PlantEvaluator::NumParams() {
+    return target == SteerAndThrottleGains ? 6 : 3;
+}
+
+double PlantEvaluator::Evaluate(const double *p) {
+    return Evaluate(p, maxDistance);
+}
+
+double PlantEvaluator::Evaluate(const double *p, double distance) {
+    bool complete;
+    return Evaluate(p, distance, HUGE_VAL, complete);
+}
+
+double PlantEvaluator::Evaluate(const double *p, double bound, bool &complete) {
+    return Evaluate(p, maxDistance, bound, complete);
+}
+
+// Drive the plant with the gains in p. Once pruneFraction of the lap
+// is driven, the run stops as soon as the estimate of its final error
+// (Twiddle::ProjectedError) reaches bound. The estimate guesses the rest
+// of the lap at pruneSlack times the steps per mile driven so far, since
+// the speed overshoots the set point early in a lap. That is a heuristic,
+// so a stopped run may have ended below bound; it is off unless
+// pruneFraction is set (pid-offline --prune).
+double PlantEvaluator::Evaluate(const double *p, double distance, double bound, bool &complete) {
+    evaluations++;
+    complete = true;
+    
+    // Gains for this run, p replaces the gains being tuned
+    double steer[3], throttle[3];
+    for(int j=0; j<3; j++) {
+        steer[j] = steerGains[j];
+        throttle[j] = throttleGains[j];
+    }
+    switch (target) {
+        case SteerGains:
+            for(int j=0; j<3; j++)
+                steer[j] = p[j];
+            break;
+        case ThrottleGains:
+            for(int j=0; j<3; j++)
+                throttle[j] = p[j];
+            break;
+        case SteerAndThrottleGains:
+            for(int j=0; j<3; j++) {
+                steer[j] = p[j];
+                throttle[j] = p[j+3];
+            }
+            break;
+    }
+    
+    // Construct and initialize the PID controllers
+    PID pidSteer;
+    PID pidThrottle;
+    double sBounds[2] = {steerBounds[0], steerBounds[1]};
+    double tBounds[2] = {throttleBounds[0], throttleBounds[1]};
+    double sSet = setCte;
+    double tSet = setSpeed;
+    int n2error = nSteps;
+    pidSteer.Init(steer, sBounds, &sSet, &n2error);
+    pidThrottle.Init(throttle, tBounds, &tSet, &n2error);
+    
+    // Spawn the car
+    Plant car = plant;
+    car.Reset(startCte, startSpeed);
+    
+    double traveled = 0.;
+    int step;
+    for(step=0; step<maxSteps; step++) {
+        Telemetry telemetry = car.Sense();
+        double cte = telemetry.cte;
+        double speed = telemetry.speed;
+        double throttleValue = 1.;
+        double steerValue = 0.;
+        
+        // Get PID control values given current cte and speed (or start controller if necessary)
+        if(pidSteer.isInitialized) {
+            steerValue = pidSteer.ControlOutput(cte);
+            throttleValue = pidThrottle.ControlOutput(speed);
+        } else {
+            pidSteer.Start(cte);
+            pidThrottle.Start(speed);
+        }
+        car.Step(steerValue, throttleValue);
+        
+        // Accumulate distance over the plant step, and check stopping
+        // criteria
+        traveled += speed*car.dt/3600.;
+        if( (traveled > distance) || (fabs(cte) > cteMax) )
+            break;
+        
+        // Stop if this run is not expected to beat the bound
+        if(bound < HUGE_VAL && traveled > pruneFraction*distance) {
+            double fraction = traveled/distance;
+            double projected = Twiddle::ProjectedError(pidSteer.GetError(), pidSteer.nSteps, pidSteer.nCalls, fraction, pruneSlack);
+            double throttleProjected = Twiddle::ProjectedError(pidThrottle.GetError(), pidThrottle.nSteps, pidThrottle.nCalls, fraction, pruneSlack);
+            if(target == ThrottleGains)
+                projected = throttleProjected;
+            else if(target == SteerAndThrottleGains)
+                projected += throttleWeight*throttleProjected;
+            if(projected >= bound) {
+                complete = false;
+                pruned++;
+                break;
+            }
+        }
+    }
+    steps += step;
+    
+    double steerError = Twiddle::NormalizeError(pidSteer.GetError(), pidSteer.nSteps, pidSteer.nCalls);
+    double throttleError = Twiddle::NormalizeError(pidThrottle.GetError(), pidThrottle.nSteps, pidThrottle.nCalls);
+    switch (target) {
+        case SteerGains:
+            return steerError;
+        case ThrottleGains:
+            return throttleError;
+        default:
+            return steerError + throttleWeight*throttleError;
+    }
+}
@@ -0,0 +1,143 @@
+//
+//  Evaluator.h
+//  PID
+//
+// Scoring of a gain set. Tuners hand a parameter vector to a
+// GainEvaluator and get back the error Twiddle::SetError would have
+// computed for a simulator run with those gains.
+//
+
+#ifndef Evaluator_h
+#define Evaluator_h
+
+#include <atomic>
+#include "Plant.h"
+
+enum GainTarget {SteerGains, ThrottleGains, SteerAndThrottleGains};
+
+class GainEvaluator {
+public:
+    /*
+     * Destructor.
+     */
+    virtual ~GainEvaluator();
+    
+    /*
+     * Number of parameters Evaluate expects
+     */
+    virtual int NumParams() = 0;
+    
+    /*
+     * Return the error for parameter vector p
+     */
+    virtual double Evaluate(const double *p) = 0;
+    
+    /*
+     * Return the error for p over a lap of the given length (miles).
+     * The default scores a full lap.
+     */
+    virtual double Evaluate(const double *p, double distance);
+    
+    /*
+     * Return the error for p, or stop early once the error is estimated
+     * not to beat bound. complete is false if the run was stopped; the
+     * error returned is then at least bound, but the full run might
+     * have scored lower. The default never stops.
+     */
+    virtual double Evaluate(const double *p, double bound, bool &complete);
+};
+
+/*
+ * Evaluator that drives the offline plant. Evaluate only reads
+ * settings and bumps an atomic counter so one evaluator can be
+ * shared between threads.
+ */
+class PlantEvaluator : public GainEvaluator {
+    // track driven by each evaluation
+    const Track &track;
+    
+public:
+    // which gains the parameter vector holds
+    GainTarget target;
+    
+    // gains used for the controller that is not being tuned
+    double steerGains[3];
+    double throttleGains[3];
+    
+    // PID bounds
+    double steerBounds[2];
+    double throttleBounds[2];
+    
+    // Desired set points
+    double setCte;
+    double setSpeed;
+    
+    // steps before error accumulation
+    int nSteps;
+    
+    // stopping criteria
+    double maxDistance;
+    double cteMax;
+    int maxSteps;
+    
+    // weight of the speed error when both controllers are tuned
+    double throttleWeight;
+    
+    // simulator spawn state
+    double startCte;
+    double startSpeed;
+    
+    // fraction of the lap driven before a run may be stopped early
+    // (HUGE_VAL, the default, never stops one), and allowance on the
+    // steps per mile of the rest of the lap
+    double pruneFraction;
+    double pruneSlack;
+    
+    // plant used as a template for every evaluation
+    Plant plant;
+    
+    // number of evaluations run, how many were stopped early and
+    // total plant steps
+    std::atomic<long> evaluations;
+    std::atomic<long> pruned;
+    std::atomic<long> steps;
+    
+    /*
+     * Constructor
+     */
+    PlantEvaluator(const Track &track, GainTarget target);
+    
+    /*
+     * Destructor.
+     */
+    virtual ~PlantEvaluator();
+    
+    /*
+     * 3 for a single controller, 6 for steer and throttle
+     */
+    int NumParams();
+    
+    /*
+     * Drive maxDistance with gains p and return the error
+     */
+    double Evaluate(const double *p);
+    
+    /*
+     * Drive the given distance with gains p and return the error
+     */
+    double Evaluate(const double *p, double distance);
+    
+    /*
+     * Drive maxDistance with gains p, stopping once the error is
+     * estimated not to beat bound
+     */
+    double Evaluate(const double *p, double bound, bool &complete);
+    
+    /*
+     * Drive the given distance with gains p, stopping once the error
+     * is estimated not to beat bound
+     */
+    double Evaluate(const double *p, double distance, double bound, bool &complete);
+};
+
+#endif /* Evaluator_h */
@@ -0,0 +1,108 @@
+//
+//  Histogram.cpp
+//  pid
+//
+// Classes Histogram and LatencyStats
+// Bucket b < 32 holds the value b. Above that, bucket (r+1)*32 + s
+// holds values whose top bit is r+5 and whose next five bits are s.
+//
+
+#include "Histogram.h"
+
+using namespace std;
+
+Histogram::Histogram() {
+    Reset();
+};
+
+Histogram::~Histogram() {};
+
+uint64_t Histogram::BucketValue(int bucket) {
+    if(bucket < subBuckets)
+        return uint64_t(bucket);
+    int shift = bucket/subBuckets - 1;
+    uint64_t sub = uint64_t(bucket % subBuckets) | uint64_t(subBuckets);
+    return ((sub + 1) << shift) - 1;
+}
+
+uint64_t Histogram::Count() {
+    uint64_t total = 0;
+    for(int i=0; i<numBuckets; i++)
+        total += counts[i].load(memory_order_relaxed);
+    return total;
+}
+
+uint64_t Histogram::Sum() {
+    return sum.load(memory_order_relaxed);
+}
+
+// Walk the buckets until the requested fraction of samples is covered
+uint64_t Histogram::Percentile(double q) {
+    uint64_t snapshot[numBuckets];
+    uint64_t total = 0;
+    for(int i=0; i<numBuckets; i++) {
+        snapshot[i] = counts[i].load(memory_order_relaxed);
+        total += snapshot[i];
+    }
+    if(total == 0)
+        return 0;
+    uint64_t target = uint64_t(q*total);
+    if(target >= total)
+        target = total - 1;
+    uint64_t seen = 0;
+    for(int i=0; i<numBuckets; i++) {
+        seen += snapshot[i];
+        if(seen > target) {
+            uint64_t value = BucketValue(i);
+            uint64_t m = Max();
+            return value < m ? value : m;
+        }
+    }
+    return Max();
+}
+
+uint64_t Histogram::Max() {
+    return maxValue.load(memory_order_relaxed);
+}
+
+void Histogram::Reset() {
+    for(int i=0; i<numBuckets; i++)
+        counts[i].store(0, memory_order_relaxed);
+    maxValue.store(0, memory_order_relaxed);
+    sum.store(0, memory_order_relaxed);
+}
+
+void Histogram::Add(Histogram &other) {
+    for(int i=0; i<numBuckets; i++)
+        counts[i].fetch_add(other.counts[i].load(memory_order_relaxed), memory_order_relaxed);
+    sum.fetch_add(other.Sum(), memory_order_relaxed);
+    uint64_t m = other.Max();
+    if(m > Max())
+        maxValue.store(m, memory_order_relaxed);
+}
+
+LatencyStats::LatencyStats() {};
+
+LatencyStats::~LatencyStats() {};
+
+const char *LatencyStats::Name(int stage) {
+    static const char *names[NumStages] = {"decode", "parse", "control", "encode", "send", "total"};
+    return names[stage];
+}
+
+void LatencyStats::Add(LatencyStats &other) {
+    for(int i=0; i<NumStages; i++)
+        stage[i].Add(other.stage[i]);
+}
+
+void LatencyStats::Dump(FILE *out) {
+    fprintf(out, "%-8s %10s %10s %10s %10s %10s\n", "stage", "count", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+    for(int i=0; i<NumStages; i++) {
+        Histogram &h = stage[i];
+        fprintf(out, "%-8s %10llu %10llu %10llu %10llu %10llu\n", Name(i),
+                (unsigned long long)h.Count(), (unsigned long long)h.Percentile(0.5),
+                (unsigned long long)h.Percentile(0.99), (unsigned long long)h.Percentile(0.999),
+                (unsigned long long)h.Max());
+    }
+    fflush(out);
+}
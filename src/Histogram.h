@@ -0,0 +1,148 @@
+//
+//  Histogram.h
+//  PID
+//
+// Log-linear (HDR style) latency histograms. Each power of two range
+// of nanoseconds is split into 32 buckets, giving about 3% resolution
+// from 1 ns to 18 minutes. Counts are atomics so the histograms can be
+// read or dumped while the event loop is recording into them.
+//
+
+#ifndef Histogram_h
+#define Histogram_h
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+
+class Histogram {
+public:
+    // sub-buckets per power of two
+    static const int subBucketBits = 5;
+    static const int subBuckets = 1 << subBucketBits;
+    
+    // powers of two covered
+    static const int ranges = 40;
+    static const int numBuckets = (ranges + 1)*subBuckets;
+    
+    /*
+     * Constructor
+     */
+    Histogram();
+    
+    /*
+     * Destructor.
+     */
+    virtual ~Histogram();
+    
+    /*
+     * Add a sample (nanoseconds)
+     */
+    void Record(uint64_t value) {
+        counts[Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t m = maxValue.load(std::memory_order_relaxed);
+        if(value > m)
+            maxValue.store(value, std::memory_order_relaxed);
+    }
+    
+    /*
+     * Bucket holding a value
+     */
+    static int Bucket(uint64_t value) {
+        if(value < uint64_t(subBuckets))
+            return int(value);
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - subBucketBits;
+        if(shift >= ranges)
+            return numBuckets - 1;
+        return (shift + 1)*subBuckets + int((value >> shift) & (subBuckets - 1));
+    }
+    
+    /*
+     * Largest value that falls in a bucket
+     */
+    static uint64_t BucketValue(int bucket);
+    
+    /*
+     * Number of samples
+     */
+    uint64_t Count();
+    
+    /*
+     * Sum of all samples, exact rather than from the buckets
+     */
+    uint64_t Sum();
+    
+    /*
+     * Value at quantile q (0 to 1)
+     */
+    uint64_t Percentile(double q);
+    
+    /*
+     * Largest sample
+     */
+    uint64_t Max();
+    
+    /*
+     * Clear all counts
+     */
+    void Reset();
+    
+    /*
+     * Add the counts of another histogram
+     */
+    void Add(Histogram &other);
+    
+private:
+    std::atomic<uint64_t> counts[numBuckets];
+    std::atomic<uint64_t> maxValue;
+    std::atomic<uint64_t> sum;
+};
+
+enum Stage {DecodeStage, ParseStage, ControlStage, EncodeStage, SendStage, TotalStage, NumStages};
+
+/*
+ * Histograms for each stage of the message handler
+ */
+class LatencyStats {
+public:
+    // one histogram per stage
+    Histogram stage[NumStages];
+    
+    /*
+     * Constructor
+     */
+    LatencyStats();
+    
+    /*
+     * Destructor.
+     */
+    virtual ~LatencyStats();
+    
+    /*
+     * Stage name
+     */
+    static const char *Name(int stage);
+    
+    /*
+     * Current time in nanoseconds
+     */
+    static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    /*
+     * Add the counts of another set of histograms
+     */
+    void Add(LatencyStats &other);
+    
+    /*
+     * Print count, p50, p99, p99.9 and max for each stage
+     */
+    void Dump(FILE *out);
+};
+
+#endif /* Histogram_h */
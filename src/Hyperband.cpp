@@ -0,0 +1,106 @@
+//
+//  Hyperband.cpp
+//  pid
+//
+// Class Hyperband
+// Each rung of a bracket is scored in parallel on the thread pool.
+// Errors are the normalized errors of Twiddle::SetError, which divide
+// by the steps driven, so gain sets are only ranked against others
+// scored on the same lap length.
+//
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include "Evaluator.h"
+#include "Hyperband.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+Hyperband::Hyperband(unsigned seed): generator(seed), p_num(0), minDistance(0.), maxDistance(0.), eta(3.),
+    samples(243), best_error(HUGE_VAL), evaluations(0), distanceDriven(0.) {};
+
+Hyperband::~Hyperband() {};
+
+void Hyperband::Init(const double *lower, const double *upper, int p_num, double minDistance, double maxDistance, double eta) {
+    this->p_num = p_num;
+    this->lower.assign(lower, lower + p_num);
+    this->upper.assign(upper, upper + p_num);
+    this->minDistance = minDistance;
+    this->maxDistance = maxDistance;
+    this->eta = eta;
+    best.assign(lower, lower + p_num);
+    best_error = HUGE_VAL;
+    evaluations = 0;
+    distanceDriven = 0.;
+}
+
+// Gains span orders of magnitude, so positive ranges are sampled in log space
+void Hyperband::Sample(double *p) {
+    uniform_real_distribution<double> uniform(0., 1.);
+    for(int j=0; j<p_num; j++) {
+        double u = uniform(generator);
+        if(lower[j] > 0.)
+            p[j] = lower[j]*pow(upper[j]/lower[j], u);
+        else
+            p[j] = lower[j] + u*(upper[j] - lower[j]);
+    }
+}
+
+double Hyperband::SuccessiveHalving(GainEvaluator &evaluator, ThreadPool &pool, int n, double distance) {
+    vector<double> gains(n*p_num);
+    for(int i=0; i<n; i++)
+        Sample(&gains[i*p_num]);
+    
+    double bracketBest = HUGE_VAL;
+    while(n > 0) {
+        // Score this rung
+        distance = fmin(distance, maxDistance);
+        vector<double> errors(n);
+        pool.ParallelFor(n, [&](int i) {
+            errors[i] = evaluator.Evaluate(&gains[i*p_num], distance);
+        });
+        evaluations += n;
+        distanceDriven += n*distance;
+        
+        // Rank
+        vector<int> order(n);
+        for(int i=0; i<n; i++)
+            order[i] = i;
+        sort(order.begin(), order.end(), [&](int a, int b) { return errors[a] < errors[b]; });
+        printf("  %4d gain sets over %6.3f miles, best error %10.3e\n", n, distance, errors[order[0]]);
+        
+        if(distance >= maxDistance) {
+            bracketBest = errors[order[0]];
+            if(bracketBest < best_error) {
+                best_error = bracketBest;
+                best.assign(&gains[order[0]*p_num], &gains[order[0]*p_num] + p_num);
+            }
+            break;
+        }
+        
+        // Keep the best 1/eta and drive them eta times further
+        int keep = max(1, int(n/eta));
+        vector<double> survivors(keep*p_num);
+        for(int i=0; i<keep; i++)
+            copy(&gains[order[i]*p_num], &gains[order[i]*p_num] + p_num, &survivors[i*p_num]);
+        gains.swap(survivors);
+        n = keep;
+        distance *= eta;
+    }
+    return bracketBest;
+}
+
+// Brackets s = sMax..0 start on laps of maxDistance*eta^-s with
+// (sMax+1)/(s+1)*eta^s gain sets, scaled so bracket sMax has samples
+double Hyperband::Run(GainEvaluator &evaluator, ThreadPool &pool) {
+    int sMax = int(floor(log(maxDistance/minDistance)/log(eta) + 1.e-9));
+    for(int s=sMax; s>=0; s--) {
+        int n = int(ceil(samples*(sMax + 1)*pow(eta, s - sMax)/(s + 1)));
+        double distance = maxDistance*pow(eta, -s);
+        printf("Bracket %d: %d gain sets starting at %6.3f miles\n", sMax - s, n, distance);
+        SuccessiveHalving(evaluator, pool, n, distance);
+    }
+    return best_error;
+}
@@ -0,0 +1,84 @@
+//
+//  Hyperband.h
+//  PID
+//
+// Successive halving and Hyperband search of the gain space. Many
+// random gain sets are scored on short laps; the best 1/eta of them
+// are driven eta times further, and so on up to a full lap. Hyperband
+// runs several such brackets, trading the number of gain sets against
+// the length of the first lap, so bad gains are dropped cheaply while
+// the search still covers the whole box given by the bounds.
+//
+
+#ifndef Hyperband_h
+#define Hyperband_h
+
+#include <random>
+#include <vector>
+
+class GainEvaluator;
+class ThreadPool;
+
+class Hyperband {
+    // random gain sets
+    std::mt19937 generator;
+    
+    /*
+     * Draw a gain set inside the bounds
+     */
+    void Sample(double *p);
+    
+public:
+    // number of parameters
+    int p_num;
+    
+    // search box; a parameter with lower > 0 is sampled log uniformly
+    std::vector<double> lower;
+    std::vector<double> upper;
+    
+    // shortest and full lap length (miles) and the halving rate
+    double minDistance;
+    double maxDistance;
+    double eta;
+    
+    // gain sets in the bracket that starts on the shortest laps; the
+    // other brackets start proportionally fewer
+    int samples;
+    
+    // best gain set scored on a full lap and its error
+    std::vector<double> best;
+    double best_error;
+    
+    // evaluations run and miles driven
+    long evaluations;
+    double distanceDriven;
+    
+    /*
+     * Constructor
+     */
+    Hyperband(unsigned seed = 1);
+    
+    /*
+     * Destructor.
+     */
+    virtual ~Hyperband();
+    
+    /*
+     * Initialize the search box, lap lengths and halving rate
+     */
+    void Init(const double *lower, const double *upper, int p_num, double minDistance, double maxDistance, double eta = 3.);
+    
+    /*
+     * Score n random gain sets on laps of the given length and promote
+     * the best 1/eta to eta times the distance until a full lap is
+     * reached. Returns the best full lap error of the bracket.
+     */
+    double SuccessiveHalving(GainEvaluator &evaluator, ThreadPool &pool, int n, double distance);
+    
+    /*
+     * Run every Hyperband bracket. Returns best_error.
+     */
+    double Run(GainEvaluator &evaluator, ThreadPool &pool);
+};
+
+#endif /* Hyperband_h */
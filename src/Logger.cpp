@@ -0,0 +1,144 @@
+//
+//  Logger.cpp
+//  pid
+//
+// Class Logger
+// The writer thread wakes every few milliseconds, formats whatever is
+// queued into one buffer and writes it with a single fwrite. Each
+// printf conversion is formatted on its own with snprintf so the
+// stored argument can be converted to the type the conversion expects.
+//
+
+#include <chrono>
+#include <string.h>
+#include <strings.h>
+#include "Logger.h"
+
+using namespace std;
+
+// Messages formatted per write, bytes per message and poll interval
+static const size_t writeBlock = 256;
+static const size_t lineSize = 512;
+static const int pollMilliseconds = 2;
+
+Logger::Logger(FILE *file, size_t capacity): file(file), ring(capacity), stopping(false), level(LogDebug), dropped(0) {
+    writer = thread(&Logger::Write, this);
+};
+
+Logger::~Logger() {
+    stopping = true;
+    writer.join();
+    if(dropped > 0)
+        fprintf(stderr, "Logger dropped %lu messages\n", dropped.load());
+};
+
+LogLevel Logger::ParseLevel(const char *name) {
+    static const char *names[] = {"debug", "info", "warning", "error", "off"};
+    for(int i=LogDebug; i<=LogOff; i++)
+        if(strcasecmp(name, names[i]) == 0)
+            return LogLevel(i);
+    return LogInfo;
+}
+
+// Drain the ring until stopped, then write what is left
+void Logger::Write() {
+    LogEntry *block = new LogEntry[writeBlock];
+    char *text = new char[writeBlock*lineSize];
+    while(true) {
+        bool last = stopping;
+        size_t n;
+        while((n = ring.Pop(block, writeBlock)) > 0) {
+            size_t length = 0;
+            for(size_t i=0; i<n; i++)
+                length += Format(block[i], text + length, lineSize);
+            fwrite(text, 1, length, file);
+            fflush(file);
+        }
+        if(last)
+            break;
+        this_thread::sleep_for(chrono::milliseconds(pollMilliseconds));
+    }
+    delete [] text;
+    delete [] block;
+}
+
+// Walk the format string and format one conversion at a time
+size_t Logger::Format(const LogEntry &entry, char *out, size_t size) {
+    size_t length = 0;
+    int arg = 0;
+    const char *f = entry.format;
+    while(*f != '\0' && length + 1 < size) {
+        if(*f != '%') {
+            out[length++] = *f++;
+            continue;
+        }
+        if(f[1] == '%') {
+            out[length++] = '%';
+            f += 2;
+            continue;
+        }
+        
+        // copy flags, width and precision, drop length modifiers. A * width
+        // or precision takes the next argument, written into the spec.
+        char spec[32];
+        size_t s = 0;
+        spec[s++] = *f++;
+        while(*f != '\0' && strchr("-+ #0123456789.*", *f) != nullptr && s < sizeof(spec) - 16) {
+            if(*f != '*') {
+                spec[s++] = *f++;
+                continue;
+            }
+            f++;
+            LogArg star = arg < entry.nArgs ? entry.args[arg] : LogArg();
+            arg++;
+            long long v = star.type == LogArg::Double ? (long long)star.d : star.i;
+            v = v < -9999 ? -9999 : (v > 9999 ? 9999 : v);
+            // a negative precision is taken as if omitted
+            if(v < 0 && s > 0 && spec[s-1] == '.')
+                s--;
+            else
+                s += snprintf(spec + s, sizeof(spec) - s, "%lld", v);
+        }
+        while(*f != '\0' && strchr("hlLqjzt", *f) != nullptr)
+            f++;
+        char conversion = *f;
+        if(conversion == '\0')
+            break;
+        f++;
+        
+        LogArg value = arg < entry.nArgs ? entry.args[arg] : LogArg();
+        arg++;
+        size_t room = size - length;
+        int n = 0;
+        if(strchr("di", conversion) != nullptr) {
+            spec[s++] = 'l'; spec[s++] = 'l'; spec[s++] = conversion; spec[s] = '\0';
+            long long v = value.type == LogArg::Double ? (long long)value.d : value.i;
+            n = snprintf(out + length, room, spec, v);
+        } else if(strchr("ouxXc", conversion) != nullptr) {
+            if(conversion != 'c') {
+                spec[s++] = 'l';
+                spec[s++] = 'l';
+            }
+            spec[s++] = conversion; spec[s] = '\0';
+            unsigned long long v = value.type == LogArg::Double ? (unsigned long long)value.d : value.u;
+            if(conversion == 'c')
+                n = snprintf(out + length, room, spec, int(v));
+            else
+                n = snprintf(out + length, room, spec, v);
+        } else if(strchr("eEfFgGaA", conversion) != nullptr) {
+            spec[s++] = conversion; spec[s] = '\0';
+            double v = value.d;
+            if(value.type == LogArg::Int)
+                v = double(value.i);
+            else if(value.type == LogArg::Unsigned)
+                v = double(value.u);
+            n = snprintf(out + length, room, spec, v);
+        } else if(conversion == 's') {
+            spec[s++] = 's'; spec[s] = '\0';
+            n = snprintf(out + length, room, spec, value.type == LogArg::String && value.s != nullptr ? value.s : "?");
+        }
+        if(n > 0)
+            length += size_t(n) < room ? n : room - 1;
+    }
+    return length;
+}
@@ -0,0 +1,143 @@
+//
+//  Logger.h
+//  PID
+//
+// Asynchronous text log for the event loop. A log call copies the
+// format string pointer and its arguments into a ring buffer; a
+// background thread does the printf style formatting and the write.
+// The format string must outlive the call (a string literal) and so
+// must any %s argument.
+//
+
+#ifndef Logger_h
+#define Logger_h
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include "SpscRing.h"
+
+enum LogLevel {LogDebug, LogInfo, LogWarning, LogError, LogOff};
+
+/*
+ * One deferred printf argument
+ */
+struct LogArg {
+    enum Type {Int, Unsigned, Double, String} type;
+    union {
+        long long i;
+        unsigned long long u;
+        double d;
+        const char *s;
+    };
+    
+    LogArg(): type(Int), i(0) {};
+    LogArg(int value): type(Int), i(value) {};
+    LogArg(long value): type(Int), i(value) {};
+    LogArg(long long value): type(Int), i(value) {};
+    LogArg(unsigned value): type(Unsigned), u(value) {};
+    LogArg(unsigned long value): type(Unsigned), u(value) {};
+    LogArg(unsigned long long value): type(Unsigned), u(value) {};
+    LogArg(double value): type(Double), d(value) {};
+    LogArg(const char *value): type(String), s(value) {};
+};
+
+// Most arguments kept per message, extras are ignored
+static const int maxLogArgs = 8;
+
+/*
+ * A message waiting to be formatted
+ */
+struct LogEntry {
+    int level;
+    int nArgs;
+    const char *format;
+    LogArg args[maxLogArgs];
+};
+
+class Logger {
+    // output
+    FILE *file;
+    
+    // messages waiting to be formatted
+    SpscRing<LogEntry> ring;
+    
+    // background writer
+    std::thread writer;
+    std::atomic<bool> stopping;
+    
+    /*
+     * Writer loop
+     */
+    void Write();
+    
+    /*
+     * Format one message into out, returns the length
+     */
+    static size_t Format(const LogEntry &entry, char *out, size_t size);
+    
+    /*
+     * Collect arguments
+     */
+    void Pack(LogEntry &) {}
+    template <typename T, typename... Rest>
+    void Pack(LogEntry &entry, T first, Rest... rest) {
+        if(entry.nArgs < maxLogArgs)
+            entry.args[entry.nArgs++] = LogArg(first);
+        Pack(entry, rest...);
+    }
+    
+public:
+    // messages below this level are discarded by the caller
+    std::atomic<int> level;
+    
+    // messages lost because the ring was full
+    std::atomic<unsigned long> dropped;
+    
+    /*
+     * Constructor. Starts the writer thread. Only one thread may log
+     * to a Logger.
+     */
+    Logger(FILE *file = stdout, size_t capacity = 1 << 12);
+    
+    /*
+     * Destructor. Writes any queued messages.
+     */
+    virtual ~Logger();
+    
+    /*
+     * Parse "debug", "info", "warning", "error" or "off"
+     */
+    static LogLevel ParseLevel(const char *name);
+    
+    /*
+     * Queue a printf style message. Never blocks.
+     */
+    template <typename... Args>
+    void Log(LogLevel messageLevel, const char *format, Args... args) {
+        if(messageLevel < level.load(std::memory_order_relaxed))
+            return;
+        LogEntry entry;
+        entry.level = messageLevel;
+        entry.nArgs = 0;
+        entry.format = format;
+        Pack(entry, args...);
+        if(!ring.Push(entry))
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    template <typename... Args>
+    void Debug(const char *format, Args... args) { Log(LogDebug, format, args...); }
+    
+    template <typename... Args>
+    void Info(const char *format, Args... args) { Log(LogInfo, format, args...); }
+    
+    template <typename... Args>
+    void Warning(const char *format, Args... args) { Log(LogWarning, format, args...); }
+    
+    template <typename... Args>
+    void Error(const char *format, Args... args) { Log(LogError, format, args...); }
+};
+
+#endif /* Logger_h */
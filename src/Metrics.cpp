@@ -0,0 +1,177 @@
+//
+//  Metrics.cpp
+//  pid
+//
+// Class Metrics
+// Formats the published atomics as Prometheus text exposition format.
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include "Metrics.h"
+
+using namespace std;
+
+SessionMetrics::SessionMetrics(): active(false), id(0), frames(0), steerError(0.), throttleError(0.), distance(0.) {
+    for(int j=0; j<3; j++) {
+        steerGains[j] = 0.;
+        throttleGains[j] = 0.;
+    }
+};
+
+void SessionMetrics::SetGains(const double *steer, const double *throttle) {
+    for(int j=0; j<3; j++) {
+        steerGains[j].store(steer[j], memory_order_relaxed);
+        throttleGains[j].store(throttle[j], memory_order_relaxed);
+    }
+}
+
+TunerMetrics::TunerMetrics(): active(false), evaluations(0), lastError(0.), bestError(0.), paramIndex(0), stepSize(0.) {};
+
+Metrics::Metrics(const char *tunerName): lastFrames(0), lastScrape(LatencyStats::Now()), closedFrames(0), unmeteredSessions(0), tunerName(tunerName), latency(nullptr), numLatency(1) {};
+
+Metrics::~Metrics() {};
+
+SessionMetrics *Metrics::Open(int id) {
+    for(int i=0; i<maxSessions; i++) {
+        bool expected = false;
+        if(sessions[i].active.compare_exchange_strong(expected, true)) {
+            sessions[i].id = id;
+            sessions[i].frames = 0;
+            sessions[i].steerError = 0.;
+            sessions[i].throttleError = 0.;
+            sessions[i].distance = 0.;
+            return &sessions[i];
+        }
+    }
+    unmeteredSessions.fetch_add(1, memory_order_relaxed);
+    return &unmetered;
+}
+
+void Metrics::Close(SessionMetrics *slot) {
+    if(slot == nullptr)
+        return;
+    if(slot == &unmetered) {
+        unmeteredSessions.fetch_sub(1, memory_order_relaxed);
+        return;
+    }
+    // a scrape sees the frames either in the slot or in the closed
+    // total, never in both or neither, so the counter never goes down
+    lock_guard<mutex> lock(renderMutex);
+    closedFrames.fetch_add(slot->frames.exchange(0), memory_order_relaxed);
+    slot->active = false;
+}
+
+// Append one formatted line
+static void Append(string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void Append(string &out, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if(n > 0)
+        out.append(line, n < int(sizeof(line)) ? n : int(sizeof(line)) - 1);
+}
+
+string Metrics::Render() {
+    lock_guard<mutex> lock(renderMutex);
+    string out;
+    
+    // frame counters and rate since the previous scrape
+    uint64_t frames = closedFrames.load(memory_order_relaxed) + unmetered.frames.load(memory_order_relaxed);
+    for(int i=0; i<maxSessions; i++)
+        if(sessions[i].active)
+            frames += sessions[i].frames.load(memory_order_relaxed);
+    uint64_t now = LatencyStats::Now();
+    double rate = 0.;
+    if(now > lastScrape && frames >= lastFrames)
+        rate = (frames - lastFrames)*1.e9/(now - lastScrape);
+    lastFrames = frames;
+    lastScrape = now;
+    
+    Append(out, "# HELP pid_frames_total Telemetry frames handled\n");
+    Append(out, "# TYPE pid_frames_total counter\n");
+    Append(out, "pid_frames_total %llu\n", (unsigned long long)frames);
+    Append(out, "# HELP pid_frames_per_second Frame rate since the previous scrape\n");
+    Append(out, "# TYPE pid_frames_per_second gauge\n");
+    Append(out, "pid_frames_per_second %g\n", rate);
+    Append(out, "# HELP pid_sessions_unmetered Sessions past the %d published slots, counted only in pid_frames_total\n", maxSessions);
+    Append(out, "# TYPE pid_sessions_unmetered gauge\n");
+    Append(out, "pid_sessions_unmetered %d\n", unmeteredSessions.load(memory_order_relaxed));
+    
+    // handler latency
+    if(latency != nullptr) {
+        LatencyStats *all = latency;
+        if(numLatency > 1) {
+            all = new LatencyStats();
+            for(int i=0; i<numLatency; i++)
+                all->Add(latency[i]);
+        }
+        static const double quantiles[4] = {0.5, 0.99, 0.999, 1.};
+        Append(out, "# HELP pid_handler_latency_seconds Message handler latency by stage\n");
+        Append(out, "# TYPE pid_handler_latency_seconds summary\n");
+        for(int s=0; s<NumStages; s++) {
+            Histogram &h = all->stage[s];
+            for(int q=0; q<4; q++) {
+                uint64_t ns = q < 3 ? h.Percentile(quantiles[q]) : h.Max();
+                Append(out, "pid_handler_latency_seconds{stage=\"%s\",quantile=\"%g\"} %g\n",
+                       LatencyStats::Name(s), quantiles[q], ns*1.e-9);
+            }
+            Append(out, "pid_handler_latency_seconds_sum{stage=\"%s\"} %g\n",
+                   LatencyStats::Name(s), h.Sum()*1.e-9);
+            Append(out, "pid_handler_latency_seconds_count{stage=\"%s\"} %llu\n",
+                   LatencyStats::Name(s), (unsigned long long)h.Count());
+        }
+        if(all != latency)
+            delete all;
+    }
+    
+    // sessions
+    static const char *terms[3] = {"kp", "ki", "kd"};
+    Append(out, "# HELP pid_gain Current PID gains\n");
+    Append(out, "# TYPE pid_gain gauge\n");
+    for(int i=0; i<maxSessions; i++) {
+        SessionMetrics &m = sessions[i];
+        if(!m.active)
+            continue;
+        for(int j=0; j<3; j++) {
+            Append(out, "pid_gain{session=\"%d\",controller=\"steer\",term=\"%s\"} %g\n", m.id.load(), terms[j], m.steerGains[j].load());
+            Append(out, "pid_gain{session=\"%d\",controller=\"throttle\",term=\"%s\"} %g\n", m.id.load(), terms[j], m.throttleGains[j].load());
+        }
+    }
+    Append(out, "# HELP pid_accumulated_error Accumulated squared error from PID::GetError\n");
+    Append(out, "# TYPE pid_accumulated_error gauge\n");
+    for(int i=0; i<maxSessions; i++) {
+        SessionMetrics &m = sessions[i];
+        if(!m.active)
+            continue;
+        Append(out, "pid_accumulated_error{session=\"%d\",controller=\"steer\"} %g\n", m.id.load(), m.steerError.load());
+        Append(out, "pid_accumulated_error{session=\"%d\",controller=\"throttle\"} %g\n", m.id.load(), m.throttleError.load());
+    }
+    Append(out, "# HELP pid_distance_miles Distance traveled in the current episode\n");
+    Append(out, "# TYPE pid_distance_miles gauge\n");
+    for(int i=0; i<maxSessions; i++) {
+        SessionMetrics &m = sessions[i];
+        if(m.active)
+            Append(out, "pid_distance_miles{session=\"%d\"} %g\n", m.id.load(), m.distance.load());
+    }
+    
+    // tuner
+    if(tuner.active) {
+        Append(out, "# HELP pid_tuner_evaluations_total Gain sets scored by the tuner\n");
+        Append(out, "# TYPE pid_tuner_evaluations_total counter\n");
+        Append(out, "pid_tuner_evaluations_total{tuner=\"%s\"} %llu\n", tunerName, (unsigned long long)tuner.evaluations.load());
+        Append(out, "# HELP pid_tuner_error Error of the last and best gain sets\n");
+        Append(out, "# TYPE pid_tuner_error gauge\n");
+        Append(out, "pid_tuner_error{tuner=\"%s\",which=\"last\"} %g\n", tunerName, tuner.lastError.load());
+        Append(out, "pid_tuner_error{tuner=\"%s\",which=\"best\"} %g\n", tunerName, tuner.bestError.load());
+        Append(out, "# HELP pid_tuner_parameter_index Parameter currently being searched\n");
+        Append(out, "# TYPE pid_tuner_parameter_index gauge\n");
+        Append(out, "pid_tuner_parameter_index{tuner=\"%s\"} %d\n", tunerName, tuner.paramIndex.load());
+        Append(out, "# HELP pid_tuner_step_size Search step size (||dp|| or bracket width)\n");
+        Append(out, "# TYPE pid_tuner_step_size gauge\n");
+        Append(out, "pid_tuner_step_size{tuner=\"%s\"} %g\n", tunerName, tuner.stepSize.load());
+    }
+    return out;
+}
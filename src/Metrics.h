@@ -0,0 +1,125 @@
+//
+//  Metrics.h
+//  PID
+//
+// Live metrics served in the Prometheus text format from the
+// onHttpRequest handler. The telemetry path only stores into atomics;
+// a scrape reads them and formats the page, so it never waits on the
+// controller and the controller never waits on it. Several event loops
+// can share one Metrics; only scrapes take a lock.
+//
+
+#ifndef Metrics_h
+#define Metrics_h
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+#include "Histogram.h"
+
+/*
+ * Published state of one controller session
+ */
+struct SessionMetrics {
+    std::atomic<bool> active;
+    std::atomic<int> id;
+    std::atomic<uint64_t> frames;
+    std::atomic<double> steerGains[3];
+    std::atomic<double> throttleGains[3];
+    std::atomic<double> steerError;
+    std::atomic<double> throttleError;
+    std::atomic<double> distance;
+    
+    /*
+     * Constructor
+     */
+    SessionMetrics();
+    
+    /*
+     * Publish gains
+     */
+    void SetGains(const double *steer, const double *throttle);
+};
+
+/*
+ * Published progress of a tuner (Twiddle, oneDsearch, ...)
+ */
+struct TunerMetrics {
+    std::atomic<bool> active;
+    std::atomic<uint64_t> evaluations;
+    std::atomic<double> lastError;
+    std::atomic<double> bestError;
+    std::atomic<int> paramIndex;
+    std::atomic<double> stepSize;
+    
+    /*
+     * Constructor
+     */
+    TunerMetrics();
+};
+
+class Metrics {
+    // frame count and time at the previous scrape, used for frames/sec
+    uint64_t lastFrames;
+    uint64_t lastScrape;
+    
+    // frames handled by sessions that have closed
+    std::atomic<uint64_t> closedFrames;
+    
+    // shared by the sessions opened once every slot is taken, so their
+    // frames still count toward the total
+    SessionMetrics unmetered;
+    
+    // sessions currently sharing unmetered
+    std::atomic<int> unmeteredSessions;
+    
+    // one scrape at a time
+    std::mutex renderMutex;
+    
+public:
+    // most sessions published at once
+    static const int maxSessions = 64;
+    
+    // per session slots
+    SessionMetrics sessions[maxSessions];
+    
+    // tuner progress
+    const char *tunerName;
+    TunerMetrics tuner;
+    
+    // handler latency, nullptr if not measured
+    LatencyStats *latency;
+    
+    // number of LatencyStats at latency, one per event loop
+    int numLatency;
+    
+    /*
+     * Constructor
+     */
+    Metrics(const char *tunerName = "none");
+    
+    /*
+     * Destructor.
+     */
+    virtual ~Metrics();
+    
+    /*
+     * Claim a slot for a session. Once all slots are taken the session
+     * shares an unpublished slot that only counts its frames.
+     */
+    SessionMetrics *Open(int id);
+    
+    /*
+     * Release a session slot, nullptr is ignored. Waits for a scrape in
+     * progress so the slot's frames are counted once.
+     */
+    void Close(SessionMetrics *slot);
+    
+    /*
+     * Format all metrics. Called from the event loop threads.
+     */
+    std::string Render();
+};
+
+#endif /* Metrics_h */
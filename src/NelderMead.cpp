@@ -0,0 +1,251 @@
+//
+//  NelderMead.cpp
+//  pid
+//
+// Class NelderMead
+// This class minimizes the error over the parameter list p with the
+// Nelder-Mead simplex method. Update runs one evaluation at a time so
+// it can be driven from the simulator loop; UpdateBatch speculates on
+// all four candidate points of an iteration at once.
+//
+
+#include <algorithm>
+#include <math.h>
+#include "Evaluator.h"
+#include "NelderMead.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Expansion and contraction points along the centroid - worst direction
+static const double reflectT = 1.;
+static const double expandT = 2.;
+static const double outsideT = 0.5;
+static const double insideT = -0.5;
+
+NelderMead::NelderMead(): tolerance(0.), reflectedError(0.), vertex(0), step(EvaluateVertex),
+    p_num(0), p(nullptr), error(0.), best_error(HUGE_VAL), count(0) {};
+
+NelderMead::~NelderMead() {};
+
+// Initialize the simplex at p and p + dp[i] e_i
+
+void NelderMead::Init(double *p, const double *dp, int p_num, double tolerance) {
+    this->p = p;
+    this->p_num = p_num;
+    this->tolerance = tolerance;
+    this->dp.assign(dp, dp + p_num);
+    
+    simplex.resize((p_num + 1)*p_num);
+    for(int i=0; i<=p_num; i++) {
+        for(int j=0; j<p_num; j++)
+            simplex[i*p_num + j] = p[j];
+        if(i > 0)
+            simplex[i*p_num + i-1] += dp[i-1];
+    }
+    errors.assign(p_num + 1, HUGE_VAL);
+    centroid.resize(p_num);
+    reflected.resize(p_num);
+    best_error = HUGE_VAL;
+    count = 0;
+    vertex = 0;
+    step = EvaluateVertex;
+}
+
+void NelderMead::Order() {
+    int n = p_num;
+    vector<int> order(n + 1);
+    for(int i=0; i<=n; i++)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return errors[a] < errors[b]; });
+    vector<double> sorted(simplex.size());
+    vector<double> sortedErrors(n + 1);
+    for(int i=0; i<=n; i++) {
+        for(int j=0; j<n; j++)
+            sorted[i*n + j] = simplex[order[i]*n + j];
+        sortedErrors[i] = errors[order[i]];
+    }
+    simplex.swap(sorted);
+    errors.swap(sortedErrors);
+    best_error = errors[0];
+}
+
+void NelderMead::Centroid() {
+    int n = p_num;
+    for(int j=0; j<n; j++) {
+        centroid[j] = 0.;
+        for(int i=0; i<n; i++)
+            centroid[j] += simplex[i*n + j];
+        centroid[j] /= n;
+    }
+}
+
+void NelderMead::Point(double t, double *x) {
+    const double *worst = &simplex[p_num*p_num];
+    for(int j=0; j<p_num; j++)
+        x[j] = centroid[j] + t*(centroid[j] - worst[j]);
+}
+
+void NelderMead::Accept(const double *x, double error) {
+    for(int j=0; j<p_num; j++)
+        simplex[p_num*p_num + j] = x[j];
+    errors[p_num] = error;
+}
+
+void NelderMead::ShrinkSimplex() {
+    for(int i=1; i<=p_num; i++)
+        for(int j=0; j<p_num; j++)
+            simplex[i*p_num + j] = simplex[j] + 0.5*(simplex[i*p_num + j] - simplex[j]);
+}
+
+bool NelderMead::Small() {
+    for(int i=1; i<=p_num; i++)
+        for(int j=0; j<p_num; j++)
+            if(fabs(simplex[i*p_num + j] - simplex[j]) > tolerance*fabs(dp[j]))
+                return false;
+    return true;
+}
+
+bool NelderMead::NextIteration() {
+    Order();
+    if(Small()) {
+        for(int j=0; j<p_num; j++)
+            p[j] = simplex[j];
+        step = Converged;
+        return true;
+    }
+    count++;
+    Centroid();
+    Point(reflectT, p);
+    step = Reflect;
+    return false;
+}
+
+// Take the error of p and return the next gains in p
+// Returns true if the simplex has converged...
+bool NelderMead::Update() {
+    int n = p_num;
+    switch (step) {
+        case EvaluateVertex:
+        case Shrink:
+            // Score the vertices one at a time, vertex 0 stays put in a shrink
+            errors[vertex] = error;
+            vertex++;
+            if(vertex <= n) {
+                for(int j=0; j<n; j++)
+                    p[j] = simplex[vertex*n + j];
+                return false;
+            }
+            return NextIteration();
+            
+        case Reflect:
+            for(int j=0; j<n; j++)
+                reflected[j] = p[j];
+            reflectedError = error;
+            if(error < errors[0]) {
+                // Better than the best, try going further
+                Point(expandT, p);
+                step = Expand;
+                return false;
+            }
+            if(error < errors[n-1]) {
+                Accept(&reflected[0], error);
+                return NextIteration();
+            }
+            if(error < errors[n])
+                Point(outsideT, p);
+            else
+                Point(insideT, p);
+            step = (error < errors[n]) ? ContractOutside : ContractInside;
+            return false;
+            
+        case Expand:
+            if(error < reflectedError)
+                Accept(p, error);
+            else
+                Accept(&reflected[0], reflectedError);
+            return NextIteration();
+            
+        case ContractOutside:
+        case ContractInside:
+            if( (step == ContractOutside && error <= reflectedError) ||
+                (step == ContractInside && error < errors[n]) ) {
+                Accept(p, error);
+                return NextIteration();
+            }
+            // Neither contraction helped, shrink toward the best vertex
+            ShrinkSimplex();
+            vertex = 1;
+            for(int j=0; j<n; j++)
+                p[j] = simplex[n + j];
+            step = Shrink;
+            return false;
+            
+        default:
+            return true;
+    }
+}
+
+// Speculative iteration: the reflection, expansion and both contractions
+// are scored together, so an iteration costs one round of evaluations
+// instead of up to two in sequence. Each candidate only matters below
+// some error, which is passed on as its pruning bound.
+bool NelderMead::UpdateBatch(GainEvaluator &evaluator, ThreadPool &pool) {
+    int n = p_num;
+    if(step == Converged)
+        return true;
+    if(step == EvaluateVertex) {
+        pool.ParallelFor(n + 1, [&](int i) {
+            errors[i] = evaluator.Evaluate(&simplex[i*n]);
+        });
+        Order();
+        Centroid();
+    }
+    
+    // Expansion is only used when the reflection beats the best vertex,
+    // the contractions only when they beat the worst
+    const double t[4] = {reflectT, expandT, outsideT, insideT};
+    const double bound[4] = {errors[n], errors[0], errors[n], errors[n]};
+    vector<double> points(4*n);
+    double candidateErrors[4];
+    for(int k=0; k<4; k++)
+        Point(t[k], &points[k*n]);
+    pool.ParallelFor(4, [&](int k) {
+        bool complete;
+        candidateErrors[k] = evaluator.Evaluate(&points[k*n], bound[k], complete);
+    });
+    
+    double fr = candidateErrors[0];
+    if(fr < errors[0]) {
+        if(candidateErrors[1] < fr)
+            Accept(&points[n], candidateErrors[1]);
+        else
+            Accept(&points[0], fr);
+    } else if(fr < errors[n-1]) {
+        Accept(&points[0], fr);
+    } else if(fr < errors[n] && candidateErrors[2] <= fr) {
+        Accept(&points[2*n], candidateErrors[2]);
+    } else if(fr >= errors[n] && candidateErrors[3] < errors[n]) {
+        Accept(&points[3*n], candidateErrors[3]);
+    } else {
+        ShrinkSimplex();
+        pool.ParallelFor(n, [&](int i) {
+            errors[i+1] = evaluator.Evaluate(&simplex[(i+1)*n]);
+        });
+    }
+    return NextIteration();
+}
+
+// Error the gains in p have to beat to change the outcome of this step
+double NelderMead::Bound() {
+    switch (step) {
+        case Reflect:
+        case ContractOutside:
+        case ContractInside:
+            return errors[p_num];
+        case Expand:
+            return reflectedError;
+        default:
+            return HUGE_VAL;
+    }
+}
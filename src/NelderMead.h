@@ -0,0 +1,134 @@
+//
+//  NelderMead.h
+//  PID
+//
+// Nelder-Mead simplex search over the PID gains. Like Twiddle, the
+// caller evaluates the gains in p, stores the result in error and
+// calls Update for the next gains. UpdateBatch instead runs one whole
+// simplex iteration, scoring the reflection, expansion and both
+// contraction points concurrently before choosing between them.
+//
+
+#ifndef NelderMead_h
+#define NelderMead_h
+
+#include <vector>
+
+class GainEvaluator;
+class ThreadPool;
+
+enum SimplexStep {EvaluateVertex, Reflect, Expand, ContractOutside, ContractInside, Shrink, Converged};
+
+class NelderMead {
+    // stopping tolerance, relative to the initial steps
+    double tolerance;
+    
+    // initial steps, used to scale the simplex size
+    std::vector<double> dp;
+    
+    // p_num+1 vertices of p_num gains and their errors, best first
+    // once ordered
+    std::vector<double> simplex;
+    std::vector<double> errors;
+    
+    // centroid of all but the worst vertex
+    std::vector<double> centroid;
+    
+    // reflected point and its error
+    std::vector<double> reflected;
+    double reflectedError;
+    
+    // vertex being evaluated in EvaluateVertex and Shrink
+    int vertex;
+    
+    // flag to indicate which step of the simplex iteration the routine is in
+    SimplexStep step;
+    
+    /*
+     * Sort the vertices by error
+     */
+    void Order();
+    
+    /*
+     * Centroid of all vertices but the worst
+     */
+    void Centroid();
+    
+    /*
+     * Point centroid + t*(centroid - worst): t = 1 reflects, 2 expands,
+     * 0.5 and -0.5 contract outside and inside
+     */
+    void Point(double t, double *x);
+    
+    /*
+     * Replace the worst vertex
+     */
+    void Accept(const double *x, double error);
+    
+    /*
+     * Move every vertex halfway toward the best
+     */
+    void ShrinkSimplex();
+    
+    /*
+     * Order the simplex and either stop or set p to the next reflection
+     */
+    bool NextIteration();
+    
+    /*
+     * True once the simplex is smaller than tolerance in every gain
+     */
+    bool Small();
+    
+public:
+    // number of parameters
+    int p_num;
+    
+    // gains to evaluate next, the best gains once converged
+    double *p;
+    
+    // error of the gains in p
+    double error;
+    
+    // best error
+    double best_error;
+    
+    // simplex iterations
+    int count;
+    
+    /*
+     * Constructor
+     */
+    NelderMead();
+    
+    /*
+     * Destructor.
+     */
+    virtual ~NelderMead();
+    
+    /*
+     * Initialize with gains p and a simplex of one step dp[i] along
+     * each gain
+     */
+    void Init(double *p, const double *dp, int p_num, double tolerance);
+    
+    /*
+     * Take the error of the gains in p and set p to the next gains.
+     * Returns true when the simplex has converged.
+     */
+    bool Update();
+    
+    /*
+     * One simplex iteration with the four candidate points evaluated
+     * concurrently. Returns true when the simplex has converged.
+     */
+    bool UpdateBatch(GainEvaluator &evaluator, ThreadPool &pool);
+    
+    /*
+     * Error the gains in p have to beat to change the next step,
+     * HUGE_VAL while the simplex vertices are being scored
+     */
+    double Bound();
+};
+
+#endif /* NelderMead_h */
@@ -0,0 +1,111 @@
+//
+//  PIDBank.cpp
+//  pid
+//
+// Class PIDBank
+// ControlOutput is written as one branch free loop over restrict
+// pointers: the clamp uses the same comparisons as the getmax/getmin
+// macros in PID.cpp (which map onto maxpd/minpd) and the error
+// accumulation masks the square to +0 instead of branching on nCalls,
+// since a conditional add is not if-converted under -ftrapping-math.
+// GCC vectorizes the loop at -O3.
+//
+
+#include <stdint.h>
+#include <string.h>
+#include "PIDBank.h"
+
+using namespace std;
+
+PIDBank::PIDBank(size_t size): size(0) {
+    Resize(size);
+};
+
+PIDBank::~PIDBank() {};
+
+void PIDBank::Resize(size_t size) {
+    this->size = size;
+    Kp.resize(size, 0.);
+    Ki.resize(size, 0.);
+    Kd.resize(size, 0.);
+    lower.resize(size, -1.);
+    upper.resize(size, 1.);
+    setPoint.resize(size, 0.);
+    pError.resize(size, 0.);
+    iError.resize(size, 0.);
+    dError.resize(size, 0.);
+    accumulatedError.resize(size, 0.);
+    nCalls.resize(size, 0);
+    nSteps.resize(size, 0);
+}
+
+void PIDBank::Init(size_t i, const double *gains, const double *bounds, double setPoint, int n2error) {
+    StoreGains(i, gains);
+    StoreBounds(i, bounds);
+    this->setPoint[i] = setPoint;
+    nSteps[i] = n2error;
+}
+
+void PIDBank::StoreGains(size_t i, const double *gains) {
+    Kp[i] = gains[0];
+    Ki[i] = gains[1];
+    Kd[i] = gains[2];
+}
+
+void PIDBank::StoreBounds(size_t i, const double *bounds) {
+    lower[i] = bounds[0];
+    upper[i] = bounds[1];
+}
+
+// Same initialization as PID::Start
+void PIDBank::Start(size_t i, double inputSignal) {
+    double deviation = inputSignal - setPoint[i];
+    pError[i] = deviation;
+    iError[i] = deviation;
+    dError[i] = 0.;
+    accumulatedError[i] = 0.;
+    nCalls[i] = 0;
+}
+
+void PIDBank::Start(const double *input) {
+    for(size_t i=0; i<size; i++)
+        Start(i, input[i]);
+}
+
+// PID::UpdateError, TotalError and the clamp of PID::ControlOutput
+// over n controllers. GCC only honours restrict on parameters, so the
+// loop lives in its own function.
+static void ControlKernel(size_t n, const double *__restrict__ input, double *__restrict__ output,
+                          const double *__restrict__ Kp, const double *__restrict__ Ki, const double *__restrict__ Kd,
+                          const double *__restrict__ lower, const double *__restrict__ upper,
+                          const double *__restrict__ setPoint, double *__restrict__ pError,
+                          double *__restrict__ iError, double *__restrict__ dError,
+                          double *__restrict__ accumulatedError, int *__restrict__ nCalls,
+                          const int *__restrict__ nSteps) {
+    for(size_t i=0; i<n; i++) {
+        double deviation = input[i] - setPoint[i];
+        dError[i] = deviation - pError[i];
+        pError[i] = deviation;
+        iError[i] += deviation;
+        nCalls[i]++;
+        
+        // accumulate deviation^2 once nCalls > nSteps, adding +0 otherwise
+        double square = deviation*deviation;
+        uint64_t bits;
+        memcpy(&bits, &square, sizeof(bits));
+        bits &= -uint64_t(nCalls[i] > nSteps[i]);
+        memcpy(&square, &bits, sizeof(bits));
+        accumulatedError[i] += square;
+        
+        double outputSignal = -(Kp[i]*pError[i] + Ki[i]*iError[i] + Kd[i]*dError[i]);
+        outputSignal = outputSignal > lower[i] ? outputSignal : lower[i];
+        outputSignal = outputSignal < upper[i] ? outputSignal : upper[i];
+        output[i] = outputSignal;
+    }
+}
+
+void PIDBank::ControlOutput(const double *input, double *output) {
+    ControlKernel(size, input, output, Kp.data(), Ki.data(), Kd.data(), lower.data(), upper.data(),
+                  setPoint.data(), pError.data(), iError.data(), dError.data(),
+                  accumulatedError.data(), nCalls.data(), nSteps.data());
+}
@@ -0,0 +1,104 @@
+//
+//  PIDBank.h
+//  PID
+//
+// A bank of PID controllers advanced in lock step. Gains, bounds, set
+// points and error terms are stored as one array per field so the
+// update loop runs over contiguous doubles and the compiler can
+// vectorize it (SSE2/AVX2 on x86, NEON on ARM). Every lane computes
+// exactly what PID::ControlOutput computes, in the same order, so the
+// results are bit for bit identical as long as both are compiled with
+// the same floating point contraction setting.
+//
+
+#ifndef PIDBank_h
+#define PIDBank_h
+
+#include <stddef.h>
+#include <vector>
+
+class PIDBank {
+    // number of controllers
+    size_t size;
+    
+public:
+    // coefficients
+    std::vector<double> Kp;
+    std::vector<double> Ki;
+    std::vector<double> Kd;
+    
+    // output lower and upper limits
+    std::vector<double> lower;
+    std::vector<double> upper;
+    
+    // signal set points
+    std::vector<double> setPoint;
+    
+    // errors
+    std::vector<double> pError;
+    std::vector<double> iError;
+    std::vector<double> dError;
+    std::vector<double> accumulatedError;
+    
+    // number of calls and number of steps before accumulating error
+    std::vector<int> nCalls;
+    std::vector<int> nSteps;
+    
+    /*
+     * Constructor
+     */
+    PIDBank(size_t size = 0);
+    
+    /*
+     * Destructor.
+     */
+    virtual ~PIDBank();
+    
+    /*
+     * Number of controllers
+     */
+    size_t Size() const { return size; }
+    
+    /*
+     * Change the number of controllers
+     */
+    void Resize(size_t size);
+    
+    /*
+     * Initialize controller i as PID::Init does
+     */
+    void Init(size_t i, const double *gains, const double *bounds, double setPoint, int n2error);
+    
+    /*
+     * Store the gains {Kp, Ki, Kd} of controller i
+     */
+    void StoreGains(size_t i, const double *gains);
+    
+    /*
+     * Store the output bounds of controller i
+     */
+    void StoreBounds(size_t i, const double *bounds);
+    
+    /*
+     * Start controller i
+     */
+    void Start(size_t i, double inputSignal);
+    
+    /*
+     * Start all controllers, input holds one signal per controller
+     */
+    void Start(const double *input);
+    
+    /*
+     * Advance all controllers one step, writing one control value per
+     * controller to output
+     */
+    void ControlOutput(const double *input, double *output);
+    
+    /*
+     * Return the accumulated error of controller i
+     */
+    double GetError(size_t i) const { return accumulatedError[i]; }
+};
+
+#endif /* PIDBank_h */
@@ -0,0 +1,202 @@
+//
+//  Plant.cpp
+//  pid
+//
+// Classes Track and Plant
+// These classes model the simulator track and car. The car follows
+// the kinematic bicycle model
+//   x'   = v cos(psi)
+//   y'   = v sin(psi)
+//   psi' = -v/L tan(delta)
+//   v'   = maxAccel*throttle - drag*v
+// where a positive steering value turns the car to the right, as it
+// does in the simulator.
+//
+
+#include <fstream>
+#include <math.h>
+#include <stdio.h>
+#include "Plant.h"
+
+using namespace std;
+
+// meters/second to miles/hour
+static const double mps2mph = 2.2369362920544;
+
+Track::Track(): length(0.) {};
+
+Track::~Track() {};
+
+// Store the centerline and the arc length to each point
+void Track::SetPoints(const vector<double> &x, const vector<double> &y) {
+    this->x = x;
+    this->y = y;
+    int n = Size();
+    s.resize(n);
+    double sum = 0.;
+    for(int i=0; i<n; i++) {
+        s[i] = sum;
+        int j = (i+1) % n;
+        sum += sqrt((x[j]-x[i])*(x[j]-x[i]) + (y[j]-y[i])*(y[j]-y[i]));
+    }
+    length = sum;
+}
+
+// Read "x y" or "x,y" pairs. A point repeating the one before it, or a
+// last point closing the loop onto the first, would make a zero length
+// segment that SegmentDistance divides by, so it is skipped.
+bool Track::Load(const string &filename) {
+    ifstream in(filename.c_str());
+    if(!in)
+        return false;
+    vector<double> px, py;
+    string line;
+    while(getline(in, line)) {
+        double a, b;
+        if(sscanf(line.c_str(), "%lf%*[ ,\t]%lf", &a, &b) == 2) {
+            if(!px.empty() && a == px.back() && b == py.back())
+                continue;
+            px.push_back(a);
+            py.push_back(b);
+        }
+    }
+    if(px.size() > 1 && px.back() == px[0] && py.back() == py[0]) {
+        px.pop_back();
+        py.pop_back();
+    }
+    if(px.size() < 3)
+        return false;
+    SetPoints(px, py);
+    return true;
+}
+
+int Track::Size() const {
+    return int(x.size());
+}
+
+// Squared distance from (px, py) to segment i and the cross product
+// of the segment direction with the offset, positive to the left
+static double SegmentDistance(const Track &track, int i, double px, double py, double &cross) {
+    int j = (i+1) % track.Size();
+    double tx = track.x[j]-track.x[i];
+    double ty = track.y[j]-track.y[i];
+    double t = ((px-track.x[i])*tx + (py-track.y[i])*ty)/(tx*tx + ty*ty);
+    t = fmax(0., fmin(1., t));
+    double dx = px - (track.x[i] + t*tx);
+    double dy = py - (track.y[i] + t*ty);
+    cross = tx*(py-track.y[i]) - ty*(px-track.x[i]);
+    return dx*dx + dy*dy;
+}
+
+// Walk from the hint segment toward the closest one. The car moves
+// a fraction of a segment per step so this is usually one or two
+// projections per call.
+double Track::Cte(double px, double py, int &segment) const {
+    int n = Size();
+    double cross;
+    double best = SegmentDistance(*this, segment, px, py, cross);
+    for(int direction=1; direction>=-1; direction-=2) {
+        for(int k=0; k<n; k++) {
+            int i = ((segment + direction) % n + n) % n;
+            double c;
+            double d2 = SegmentDistance(*this, i, px, py, c);
+            if(d2 >= best)
+                break;
+            best = d2;
+            cross = c;
+            segment = i;
+        }
+    }
+    return cross > 0 ? -sqrt(best) : sqrt(best);
+}
+
+// Counter clockwise oval starting at the beginning of the lower straight
+Track Track::Oval(double straight, double radius, double spacing) {
+    vector<double> px, py;
+    int nStraight = int(ceil(straight/spacing));
+    int nTurn = int(ceil(M_PI*radius/spacing));
+    for(int i=0; i<nStraight; i++) {
+        px.push_back(straight*i/nStraight);
+        py.push_back(-radius);
+    }
+    for(int i=0; i<nTurn; i++) {
+        double a = -M_PI/2 + M_PI*i/nTurn;
+        px.push_back(straight + radius*cos(a));
+        py.push_back(radius*sin(a));
+    }
+    for(int i=0; i<nStraight; i++) {
+        px.push_back(straight*(nStraight-i)/nStraight);
+        py.push_back(radius);
+    }
+    for(int i=0; i<nTurn; i++) {
+        double a = M_PI/2 + M_PI*i/nTurn;
+        px.push_back(radius*cos(a));
+        py.push_back(radius*sin(a));
+    }
+    Track track;
+    track.SetPoints(px, py);
+    return track;
+}
+
+// Counter clockwise closed curve with lobes
+Track Track::Wavy(double radius, double amplitude, int lobes, double spacing) {
+    vector<double> px, py;
+    int n = int(ceil(2*M_PI*radius/spacing));
+    for(int i=0; i<n; i++) {
+        double theta = 2*M_PI*i/n;
+        double r = radius*(1. + amplitude*sin(lobes*theta));
+        px.push_back(r*cos(theta));
+        py.push_back(r*sin(theta));
+    }
+    Track track;
+    track.SetPoints(px, py);
+    return track;
+}
+
+Plant::Plant(const Track &track): track(&track), segment(0), x(0.), y(0.), psi(0.), v(0.), delta(0.),
+    dt(0.03), wheelBase(2.67), maxSteer(25.*M_PI/180.), steerLag(0.1), maxAccel(5.), drag(0.11) {};
+
+Plant::~Plant() {};
+
+// Place the car on the first segment offset to the right
+void Plant::Reset(double cte, double speed) {
+    int j = 1 % track->Size();
+    double tx = track->x[j] - track->x[0];
+    double ty = track->y[j] - track->y[0];
+    double len = sqrt(tx*tx + ty*ty);
+    tx /= len;
+    ty /= len;
+    
+    // right hand normal is (ty, -tx)
+    x = track->x[0] + cte*ty;
+    y = track->y[0] - cte*tx;
+    psi = atan2(ty, tx);
+    v = speed/mps2mph;
+    delta = 0.;
+    segment = 0;
+}
+
+// Integrate the bicycle model over one time step
+void Plant::Step(double steerValue, double throttleValue) {
+    double target = steerValue*maxSteer;
+    if(steerLag > 0.)
+        delta += (target - delta)*(1. - exp(-dt/steerLag));
+    else
+        delta = target;
+    
+    x += v*cos(psi)*dt;
+    y += v*sin(psi)*dt;
+    psi -= v/wheelBase*tan(delta)*dt;
+    v += (maxAccel*throttleValue - drag*v)*dt;
+    if(v < 0.)
+        v = 0.;
+}
+
+// Report the state in telemetry units
+Telemetry Plant::Sense() {
+    Telemetry telemetry;
+    telemetry.cte = track->Cte(x, y, segment);
+    telemetry.speed = v*mps2mph;
+    telemetry.angle = delta*180./M_PI;
+    return telemetry;
+}
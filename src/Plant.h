@@ -0,0 +1,148 @@
+//
+//  Plant.h
+//  PID
+//
+// In process stand-in for the simulator. A kinematic bicycle model
+// is driven around a closed track centerline and reports cte, speed
+// and steering angle the way the telemetry event does, so a gain set
+// can be scored without the simulator.
+//
+
+#ifndef Plant_h
+#define Plant_h
+
+#include <string>
+#include <vector>
+#include "Telemetry.h"
+
+/*
+ * Closed track centerline stored as a polyline
+ */
+class Track {
+public:
+    // centerline points (meters)
+    std::vector<double> x;
+    std::vector<double> y;
+    
+    // arc length at the start of each segment (meters)
+    std::vector<double> s;
+    
+    // track length (meters)
+    double length;
+    
+    /*
+     * Constructor
+     */
+    Track();
+    
+    /*
+     * Destructor.
+     */
+    virtual ~Track();
+    
+    /*
+     * Set the centerline. The last point connects back to the first.
+     */
+    void SetPoints(const std::vector<double> &x, const std::vector<double> &y);
+    
+    /*
+     * Load centerline points from a file with one "x y" or "x,y"
+     * pair per line. Repeated points are skipped so no segment has zero
+     * length. Returns false if fewer than three distinct points are read.
+     */
+    bool Load(const std::string &filename);
+    
+    /*
+     * Number of segments
+     */
+    int Size() const;
+    
+    /*
+     * Signed distance of (px, py) from the centerline, positive to the
+     * right of the direction of travel. The segment index is a hint that
+     * is updated to the closest segment found near it.
+     */
+    double Cte(double px, double py, int &segment) const;
+    
+    /*
+     * Oval with two straights joined by half circles
+     */
+    static Track Oval(double straight, double radius, double spacing);
+    
+    /*
+     * Closed curve r(theta) = radius*(1 + amplitude*sin(lobes*theta))
+     * with bends of varying curvature
+     */
+    static Track Wavy(double radius, double amplitude, int lobes, double spacing);
+};
+
+/*
+ * Kinematic bicycle model of the simulator car
+ */
+class Plant {
+    // track being driven
+    const Track *track;
+    
+    // closest track segment
+    int segment;
+    
+public:
+    // position (meters) and heading (radians)
+    double x;
+    double y;
+    double psi;
+    
+    // speed (meters/second)
+    double v;
+    
+    // front wheel angle (radians)
+    double delta;
+    
+    // time step (seconds). The simulator sends telemetry at roughly
+    // 30 frames per second, which is the rate the gains were tuned at.
+    double dt;
+    
+    // distance between axles (meters)
+    double wheelBase;
+    
+    // wheel angle for a steering value of 1 (radians)
+    double maxSteer;
+    
+    // steering actuator time constant (seconds), 0 for no lag
+    double steerLag;
+    
+    // acceleration at full throttle (meters/second^2)
+    double maxAccel;
+    
+    // speed proportional drag (1/second)
+    double drag;
+    
+    /*
+     * Constructor
+     */
+    Plant(const Track &track);
+    
+    /*
+     * Destructor.
+     */
+    virtual ~Plant();
+    
+    /*
+     * Place the car at the start of the track, cte meters to the right
+     * of the centerline and facing along it.
+     */
+    void Reset(double cte, double speed);
+    
+    /*
+     * Advance one time step with simulator steering and throttle values
+     */
+    void Step(double steerValue, double throttleValue);
+    
+    /*
+     * Telemetry for the current state (cte, speed in mph and steering
+     * angle in degrees)
+     */
+    Telemetry Sense();
+};
+
+#endif /* Plant_h */
@@ -0,0 +1,122 @@
+//
+//  Realtime.cpp
+//  pid
+//
+// Class RealtimeMonitor
+// Allocations are counted by replacing the global operator new, which
+// only bumps a thread local counter before calling malloc. The
+// replacement is linked into a program only when it uses this file.
+//
+
+#include <alloca.h>
+#include <new>
+#include <stdlib.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+#include "Realtime.h"
+
+using namespace std;
+
+// operator new calls made by this thread
+static thread_local uint64_t threadAllocations = 0;
+
+void *operator new(size_t size) {
+    threadAllocations++;
+    void *p = malloc(size ? size : 1);
+    if(p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+bool LockMemory() {
+#ifdef __linux__
+#ifdef __GLIBC__
+    // no returning freed memory to the kernel, no mmap per allocation
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
+    return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+#else
+    return false;
+#endif
+}
+
+bool PinThread(int core) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    return false;
+#endif
+}
+
+bool SetFifoPriority(int priority) {
+#ifdef __linux__
+    sched_param param;
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+    return false;
+#endif
+}
+
+// One write per page is enough to fault it in
+void PrefaultStack(size_t bytes) {
+    volatile char *stack = (volatile char *)alloca(bytes);
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    for(size_t i=0; i<bytes; i+=page)
+        stack[i] = 0;
+}
+
+uint64_t ThreadAllocations() {
+    return threadAllocations;
+}
+
+uint64_t ThreadPageFaults() {
+#ifdef __linux__
+    rusage usage;
+    if(getrusage(RUSAGE_THREAD, &usage) != 0)
+        return 0;
+    return uint64_t(usage.ru_minflt) + uint64_t(usage.ru_majflt);
+#else
+    return 0;
+#endif
+}
+
+RealtimeMonitor::RealtimeMonitor(): faultsAtArm(0), faultsChecked(0), allocationsChecked(0), faults(0), allocations(0) {};
+
+RealtimeMonitor::~RealtimeMonitor() {};
+
+void RealtimeMonitor::Arm() {
+    faultsAtArm = ThreadPageFaults();
+    faultsChecked = 0;
+    allocationsChecked = 0;
+    faults = 0;
+    allocations = 0;
+}
+
+bool RealtimeMonitor::Check() {
+    uint64_t f = ThreadPageFaults() - faultsAtArm;
+    uint64_t a = allocations.load(memory_order_relaxed);
+    faults.store(f, memory_order_relaxed);
+    bool grown = (f > faultsChecked || a > allocationsChecked);
+    faultsChecked = f;
+    allocationsChecked = a;
+    return grown;
+}
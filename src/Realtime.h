@@ -0,0 +1,92 @@
+//
+//  Realtime.h
+//  PID
+//
+// Real time setup for an event loop thread: locked memory, a pinned
+// core, optional SCHED_FIFO priority, and counters of the page faults
+// and heap allocations that still happen once the thread is serving
+// frames. The calls are Linux specific; elsewhere they return false
+// and the counters stay at 0.
+//
+
+#ifndef Realtime_h
+#define Realtime_h
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Lock current and future pages into memory and keep freed heap
+ * memory in the process, so memory once touched never faults again
+ */
+bool LockMemory();
+
+/*
+ * Keep the calling thread on one core
+ */
+bool PinThread(int core);
+
+/*
+ * Run the calling thread under SCHED_FIFO at a priority (1 to 99)
+ */
+bool SetFifoPriority(int priority);
+
+/*
+ * Touch bytes of stack below the caller so later calls do not fault
+ */
+void PrefaultStack(size_t bytes);
+
+/*
+ * Number of operator new calls made by the calling thread
+ */
+uint64_t ThreadAllocations();
+
+/*
+ * Minor and major page faults of the calling thread
+ */
+uint64_t ThreadPageFaults();
+
+/*
+ * Page faults and allocations of an event loop thread after startup.
+ * Arm and Check run on the event loop thread; the totals can be read
+ * from any thread.
+ */
+class RealtimeMonitor {
+    // thread page faults when armed
+    uint64_t faultsAtArm;
+
+    // totals at the previous Check
+    uint64_t faultsChecked;
+    uint64_t allocationsChecked;
+
+public:
+    // page faults since Arm
+    std::atomic<uint64_t> faults;
+
+    // allocations counted on the telemetry path since Arm
+    std::atomic<uint64_t> allocations;
+
+    /*
+     * Constructor
+     */
+    RealtimeMonitor();
+
+    /*
+     * Destructor.
+     */
+    virtual ~RealtimeMonitor();
+
+    /*
+     * Start counting from now
+     */
+    void Arm();
+
+    /*
+     * Refresh the fault count. Returns true if faults or allocations
+     * have grown since the previous Check.
+     */
+    bool Check();
+};
+
+#endif /* Realtime_h */
@@ -0,0 +1,138 @@
+//
+//  Recorder.cpp
+//  pid
+//
+// Classes Recorder and LogReader
+// The recorder pushes records into a single producer ring buffer from
+// the event loop. A writer thread wakes every few milliseconds and
+// writes whatever is queued in large blocks, so the control path never
+// waits on the file.
+//
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Recorder.h"
+
+using namespace std;
+
+static const char logMagic[8] = {'P', 'I', 'D', 'L', 'O', 'G', '\0', '\0'};
+static const uint32_t logVersion = 1;
+
+// Records written per fwrite and writer poll interval
+static const size_t writeBlock = 4096;
+static const int pollMilliseconds = 2;
+
+Recorder::Recorder(const string &filename, size_t capacity): ring(capacity), stopping(false),
+    start(chrono::steady_clock::now()), sequence(0), dropped(0) {
+    file = fopen(filename.c_str(), "wb");
+    if(file == nullptr)
+        return;
+    LogHeader header;
+    memcpy(header.magic, logMagic, sizeof(logMagic));
+    header.version = logVersion;
+    header.recordSize = sizeof(LogRecord);
+    fwrite(&header, sizeof(header), 1, file);
+    writer = thread(&Recorder::Write, this);
+};
+
+Recorder::~Recorder() {
+    if(file == nullptr)
+        return;
+    stopping = true;
+    writer.join();
+    fclose(file);
+};
+
+bool Recorder::IsOpen() {
+    return file != nullptr;
+}
+
+// Drain the ring until stopped, then write what is left
+void Recorder::Write() {
+    LogRecord block[writeBlock];
+    while(true) {
+        bool last = stopping;
+        size_t n;
+        while((n = ring.Pop(block, writeBlock)) > 0)
+            fwrite(block, sizeof(LogRecord), n, file);
+        if(last)
+            break;
+        this_thread::sleep_for(chrono::milliseconds(pollMilliseconds));
+    }
+    fflush(file);
+}
+
+void Recorder::Push(RecordKind kind, double a, double b, double c) {
+    if(file == nullptr)
+        return;
+    LogRecord record;
+    record.kind = kind;
+    record.sequence = sequence++;
+    record.time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    record.value[0] = a;
+    record.value[1] = b;
+    record.value[2] = c;
+    if(!ring.Push(record))
+        dropped++;
+}
+
+void Recorder::RecordTelemetry(double cte, double speed, double angle) {
+    Push(TelemetryRecord, cte, speed, angle);
+}
+
+void Recorder::RecordCommand(double steerValue, double throttleValue) {
+    Push(CommandRecord, steerValue, throttleValue, 0.);
+}
+
+void Recorder::RecordEpisodeEnd(int index, double distance, int end) {
+    Push(EpisodeRecord, index, distance, end);
+}
+
+LogReader::LogReader(): map(nullptr), mapSize(0), records(nullptr), count(0) {};
+
+LogReader::~LogReader() {
+    Close();
+};
+
+// Map the whole file and check the header
+bool LogReader::Open(const string &filename) {
+    Close();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(LogHeader)) {
+        close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED)
+        return false;
+    
+    const LogHeader *header = (const LogHeader *)p;
+    if(memcmp(header->magic, logMagic, sizeof(logMagic)) != 0 || header->version != logVersion ||
+       header->recordSize != sizeof(LogRecord)) {
+        munmap(p, st.st_size);
+        return false;
+    }
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    
+    map = p;
+    mapSize = st.st_size;
+    records = (const LogRecord *)((const char *)p + sizeof(LogHeader));
+    count = (mapSize - sizeof(LogHeader))/sizeof(LogRecord);
+    return true;
+}
+
+void LogReader::Close() {
+    if(map != nullptr)
+        munmap(map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+    records = nullptr;
+    count = 0;
+}
@@ -0,0 +1,143 @@
+//
+//  Recorder.h
+//  PID
+//
+// Binary log of what the controller saw and sent. A log is a 16 byte
+// header followed by fixed size records:
+//   telemetry: time, cte, speed, steering angle
+//   command:   time, steering value, throttle value
+//   episode:   time, episode number, distance, how it ended
+// Records are written by a background thread; the control path only
+// copies 40 bytes into a ring buffer. Logs are read back through a
+// memory map for replay.
+//
+
+#ifndef Recorder_h
+#define Recorder_h
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include "SpscRing.h"
+
+enum RecordKind {TelemetryRecord = 1, CommandRecord = 2, EpisodeRecord = 3};
+
+/*
+ * File header
+ */
+struct LogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+/*
+ * One telemetry frame or command
+ */
+struct LogRecord {
+    uint32_t kind;
+    uint32_t sequence;
+    double time;
+    double value[3];
+};
+
+class Recorder {
+    // log file
+    FILE *file;
+    
+    // records waiting to be written
+    SpscRing<LogRecord> ring;
+    
+    // background writer
+    std::thread writer;
+    std::atomic<bool> stopping;
+    
+    // start of the recording
+    std::chrono::steady_clock::time_point start;
+    
+    // number of records pushed
+    uint32_t sequence;
+    
+    /*
+     * Writer loop
+     */
+    void Write();
+    
+    /*
+     * Queue a record
+     */
+    void Push(RecordKind kind, double a, double b, double c);
+    
+public:
+    // records lost because the ring was full
+    std::atomic<unsigned long> dropped;
+    
+    /*
+     * Constructor. Opens the log and starts the writer thread.
+     */
+    Recorder(const std::string &filename, size_t capacity = 1 << 16);
+    
+    /*
+     * Destructor. Writes any queued records and closes the log.
+     */
+    virtual ~Recorder();
+    
+    /*
+     * True if the log file was opened
+     */
+    bool IsOpen();
+    
+    /*
+     * Record a telemetry frame
+     */
+    void RecordTelemetry(double cte, double speed, double angle);
+    
+    /*
+     * Record the steering and throttle values sent
+     */
+    void RecordCommand(double steerValue, double throttleValue);
+    
+    /*
+     * Record the end of an episode; the next telemetry starts a new one
+     */
+    void RecordEpisodeEnd(int index, double distance, int end);
+};
+
+/*
+ * Memory mapped read only view of a log
+ */
+class LogReader {
+    // mapping
+    void *map;
+    size_t mapSize;
+    
+public:
+    // records in the log
+    const LogRecord *records;
+    size_t count;
+    
+    /*
+     * Constructor
+     */
+    LogReader();
+    
+    /*
+     * Destructor.
+     */
+    virtual ~LogReader();
+    
+    /*
+     * Map a log. Returns false if the file cannot be mapped or is not a log.
+     */
+    bool Open(const std::string &filename);
+    
+    /*
+     * Unmap the log
+     */
+    void Close();
+};
+
+#endif /* Recorder_h */
@@ -0,0 +1,92 @@
+//
+//  ResetTracker.cpp
+//  pid
+//
+// Class ResetTracker
+// The simulator runs at about 10 frames a second, so a car braking
+// hard loses a couple of mph and moves a fraction of a meter between
+// frames. A respawn stops the car dead and moves it back to the
+// start, which neither limit allows. A car already stopped by a crash
+// has no speed to lose, so there a respawn is any move back into the
+// start band; at rest the car creeps at most a couple of cm a frame.
+//
+
+#include "ResetTracker.h"
+
+using namespace std;
+
+// cte tolerance of the spawn handshake, the simulator prints 4 decimals
+static const double spawnTolerance = 1.e-4;
+
+// cte change in one frame that a car at rest cannot make by itself (m)
+static const double restMove = 0.05;
+
+ResetTracker::ResetTracker(double spawnCte): hasPrevious(false), requestedAt(0), waitFrames(0),
+    restSpeed(0.5), speedDrop(5.), cteJump(1.), startBand(1.), spawnCte(spawnCte), maxWaitFrames(50),
+    state(WaitingForSpawn), episodes(0), resends(0), discarded(0), lastWaitFrames(0) {};
+
+ResetTracker::~ResetTracker() {};
+
+void ResetTracker::RequestReset() {
+    state = WaitingForSpawn;
+    requestedAt = LatencyStats::Now();
+    waitFrames = 0;
+}
+
+ResetAction ResetTracker::Frame(const Telemetry &telemetry) {
+    if(state == Driving) {
+        previous = telemetry;
+        hasPrevious = true;
+        return ContinueEpisode;
+    }
+    
+    // Still waiting: is this the respawned car?
+    bool atRest = fabs(telemetry.speed) < restSpeed;
+    bool inStartBand = isnan(spawnCte) ? fabs(telemetry.cte) < startBand : fabs(telemetry.cte - spawnCte) < spawnTolerance;
+    bool spawned;
+    if(!isnan(spawnCte) && inStartBand)
+        spawned = atRest;
+    else if(!hasPrevious)
+        spawned = atRest;   // a fresh connection finds the car standing at the spawn point
+    else
+        spawned = atRest && (fabs(previous.speed) - fabs(telemetry.speed) > speedDrop ||
+                             fabs(telemetry.cte - previous.cte) > cteJump ||
+                             (inStartBand && fabs(telemetry.cte - previous.cte) > restMove));
+    
+    // No discontinuity within the wait: a car at rest in the start band
+    // is taken as respawned. A moving one did not get the reset, and one
+    // at rest elsewhere is stuck where it crashed, so ask again.
+    ResetAction action = spawned ? StartEpisode : DiscardFrame;
+    if(!spawned && waitFrames >= maxWaitFrames)
+        action = (atRest && inStartBand) ? StartEpisode : ResendReset;
+    previous = telemetry;
+    hasPrevious = true;
+    
+    switch(action) {
+        case StartEpisode:
+            state = Driving;
+            episodes++;
+            lastWaitFrames = waitFrames;
+            if(requestedAt != 0)
+                latency.Record(LatencyStats::Now() - requestedAt);
+            break;
+        case ResendReset:
+            resends++;
+            discarded++;
+            waitFrames = 0;
+            break;
+        default:
+            discarded++;
+            waitFrames++;
+            break;
+    }
+    return action;
+}
+
+void ResetTracker::Dump(FILE *out) {
+    fprintf(out, "%lu episodes started, %lu resets sent again, %lu stale frames discarded\n", episodes, resends, discarded);
+    if(latency.Count() > 0)
+        fprintf(out, "Reset latency ms: p50 %.1f p99 %.1f max %.1f\n", latency.Percentile(0.5)*1.e-6,
+                latency.Percentile(0.99)*1.e-6, latency.Max()*1.e-6);
+    fflush(out);
+}
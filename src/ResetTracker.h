@@ -0,0 +1,102 @@
+//
+//  ResetTracker.h
+//  PID
+//
+// Tracks the simulator through a reset. After the driver sends a
+// reset, telemetry from the old episode keeps arriving for a few
+// frames. The tracker discards those and starts the next episode on
+// the first frame of the respawned car, recognized by a discontinuity:
+// the speed drops to rest in one frame, the cte jumps further than the
+// car can move in one frame, or a car at rest moves back into the start
+// band. A known spawn cte can be given as a handshake and is matched
+// directly. If no respawn shows up the driver is asked to send the
+// reset again, unless the car is already at rest in the start band.
+//
+
+#ifndef ResetTracker_h
+#define ResetTracker_h
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "Histogram.h"
+#include "Telemetry.h"
+
+enum ResetState {WaitingForSpawn, Driving};
+
+enum ResetAction {DiscardFrame, StartEpisode, ContinueEpisode, ResendReset};
+
+class ResetTracker {
+    // previous frame, valid once hasPrevious is set
+    Telemetry previous;
+    bool hasPrevious;
+    
+    // when the reset was requested (ns) and frames seen since
+    uint64_t requestedAt;
+    int waitFrames;
+    
+public:
+    // speed below which the car is at rest, as it is after a respawn (mph)
+    double restSpeed;
+    
+    // speed drop in one frame that can only be a respawn (mph)
+    double speedDrop;
+    
+    // cte change in one frame that can only be a respawn (m)
+    double cteJump;
+    
+    // largest |cte| of a respawned car when no spawn cte is given (m)
+    double startBand;
+    
+    // spawn cte matched as a handshake, NAN for none
+    double spawnCte;
+    
+    // frames to wait for a respawn before asking for another reset
+    int maxWaitFrames;
+    
+    // waiting for a respawn, or driving an episode
+    ResetState state;
+    
+    // episodes started, resets sent again and stale frames discarded
+    unsigned long episodes;
+    unsigned long resends;
+    unsigned long discarded;
+    
+    // time from the reset request to the first frame of the new episode (ns)
+    Histogram latency;
+    
+    // frames discarded before the last episode started
+    int lastWaitFrames;
+    
+    /*
+     * Constructor. Starts out waiting for a car at rest.
+     */
+    ResetTracker(double spawnCte = NAN);
+    
+    /*
+     * Destructor.
+     */
+    virtual ~ResetTracker();
+    
+    /*
+     * Call right after the reset message is sent to the simulator
+     */
+    void RequestReset();
+    
+    /*
+     * Classify a telemetry frame. StartEpisode is returned for the
+     * first frame of a new episode, ContinueEpisode for the frames
+     * after it. ResendReset means no respawn has been seen within
+     * maxWaitFrames and the car is moving or stopped outside the start
+     * band, stuck where it crashed; the driver sends the reset again
+     * and the wait starts over.
+     */
+    ResetAction Frame(const Telemetry &telemetry);
+    
+    /*
+     * Print episode, resend and discard counts and the reset latency
+     */
+    void Dump(FILE *out);
+};
+
+#endif /* ResetTracker_h */
@@ -0,0 +1,102 @@
+//
+//  Session.cpp
+//  pid
+//
+// Class Session
+// This class holds the per connection state of the controller: the
+// steering and throttle PID controllers, their gains and the distance
+// traveled in the current episode.
+//
+
+#include <stdio.h>
+#include "Session.h"
+
+using namespace std;
+
+Session::Session(int id, const double *steerGains, const double *throttleGains): id(id),
+    steerBounds{-1., 1.}, throttleBounds{-1., 1.}, setCte(0.), setSpeed(35.), n2error(0),
+    distance(0.), maxDistance(10.), recorder(nullptr), metrics(nullptr) {
+    for(int j=0; j<3; j++) {
+        this->steerGains[j] = steerGains[j];
+        this->throttleGains[j] = throttleGains[j];
+    }
+    
+    // Initialize the PID controllers with inputs
+    pidSteer.Init(this->steerGains, steerBounds, &setCte, &n2error);
+    pidThrottle.Init(this->throttleGains, throttleBounds, &setSpeed, &n2error);
+};
+
+Session::~Session() {
+    delete recorder;
+};
+
+// Read "steer=" and "throttle=" gain triples from the url query
+bool Session::ParseGains(const string &url) {
+    bool found = false;
+    const char *keys[2] = {"steer=", "throttle="};
+    double *gains[2] = {steerGains, throttleGains};
+    for(int k=0; k<2; k++) {
+        auto pos = url.find(keys[k]);
+        if(pos == string::npos)
+            continue;
+        double g[3];
+        if(sscanf(url.c_str() + pos + string(keys[k]).length(), "%lf,%lf,%lf", &g[0], &g[1], &g[2]) == 3) {
+            for(int j=0; j<3; j++)
+                gains[k][j] = g[j];
+            found = true;
+        }
+    }
+    pidSteer.StoreGains(steerGains);
+    pidThrottle.StoreGains(throttleGains);
+    return found;
+}
+
+// Store the current state into the metrics slot; the scrape reads it
+// without touching the controllers
+void Session::Publish() {
+    if(metrics == nullptr)
+        return;
+    metrics->frames.fetch_add(1, memory_order_relaxed);
+    metrics->steerError.store(pidSteer.GetError(), memory_order_relaxed);
+    metrics->throttleError.store(pidThrottle.GetError(), memory_order_relaxed);
+    metrics->distance.store(distance, memory_order_relaxed);
+}
+
+// Run the controllers on one frame
+bool Session::Control(const Telemetry &telemetry, double &steerValue, double &throttleValue) {
+    throttleValue = 1.;
+    steerValue = 0.;
+    
+    // Get PID control values given current cte and speed (or start controller if necessary)
+    if(pidSteer.isInitialized) {
+        steerValue = pidSteer.ControlOutput(telemetry.cte);
+        throttleValue = pidThrottle.ControlOutput(telemetry.speed);
+    } else {
+        pidSteer.Start(telemetry.cte);
+        pidThrottle.Start(telemetry.speed);
+        episodes.Begin();
+    }
+    episodes.Frame(telemetry.cte);
+    
+    if(recorder != nullptr) {
+        recorder->RecordTelemetry(telemetry.cte, telemetry.speed, telemetry.angle);
+        recorder->RecordCommand(steerValue, throttleValue);
+    }
+    
+    // Accumulate the distance, assuming 0.1 sec per simulator increment
+    distance += telemetry.speed*0.1/3600.;
+    Publish();
+    return distance > maxDistance;
+}
+
+// Summarize, then clear everything an episode accumulates
+const EpisodeSummary &Session::EndEpisode(EpisodeEnd end) {
+    const EpisodeSummary &summary = episodes.End(end, distance, pidSteer.GetError(), pidThrottle.GetError());
+    if(recorder != nullptr)
+        recorder->RecordEpisodeEnd(summary.index, distance, end);
+    pidSteer.isInitialized = false;
+    pidThrottle.isInitialized = false;
+    distance = 0.;
+    reset.RequestReset();
+    return summary;
+}
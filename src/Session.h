@@ -0,0 +1,103 @@
+//
+//  Session.h
+//  PID
+//
+// Controller state for one simulator connection. main.cpp creates a
+// Session when a simulator connects and stores it as the websocket
+// user data, so several simulators can be driven by one process
+// without sharing PID error terms or distance.
+//
+
+#ifndef Session_h
+#define Session_h
+
+#include <string>
+#include "ControlMessage.h"
+#include "Episode.h"
+#include "Metrics.h"
+#include "PID.h"
+#include "Recorder.h"
+#include "ResetTracker.h"
+#include "Telemetry.h"
+
+class Session {
+public:
+    // session number, in order of connection
+    int id;
+    
+    // PID gains {Kp, Ki, Kd}, owned here since PID keeps a pointer to them
+    double steerGains[3];
+    double throttleGains[3];
+    
+    // PID bounds
+    double steerBounds[2];
+    double throttleBounds[2];
+    
+    // Desired set points
+    double setCte;
+    double setSpeed;
+    
+    // Number of steps before accumulating error
+    int n2error;
+    
+    // steering and throttle controllers
+    PID pidSteer;
+    PID pidThrottle;
+    
+    // distance traveled and distance at which the episode ends (miles)
+    double distance;
+    double maxDistance;
+    
+    // telemetry decoder and steer message encoder for this connection
+    TelemetryDecoder decoder;
+    ControlEncoder encoder;
+    
+    // log of telemetry and commands, nullptr when not recording
+    Recorder *recorder;
+    
+    // published state for the metrics endpoint, nullptr when not published
+    SessionMetrics *metrics;
+    
+    // summaries of the episodes driven on this connection
+    EpisodeLog episodes;
+    
+    // finds the first frame of each episode after a reset
+    ResetTracker reset;
+    
+    /*
+     * Constructor
+     */
+    Session(int id, const double *steerGains, const double *throttleGains);
+    
+    /*
+     * Destructor. Closes the recording if there is one.
+     */
+    virtual ~Session();
+    
+    /*
+     * Override gains from a connection url such as
+     * /?steer=0.2,0.003,21&throttle=0.1,0.0001,-0.03
+     * Returns true if any gains were read.
+     */
+    bool ParseGains(const std::string &url);
+    
+    /*
+     * Publish gains, errors and distance to metrics
+     */
+    void Publish();
+    
+    /*
+     * Get PID control values for a telemetry frame (or start the
+     * controllers if necessary) and accumulate distance. Returns
+     * true when maxDistance has been traveled.
+     */
+    bool Control(const Telemetry &telemetry, double &steerValue, double &throttleValue);
+    
+    /*
+     * Record the summary of the current episode, reset the controllers
+     * and distance, and wait for the simulator to respawn the car
+     */
+    const EpisodeSummary &EndEpisode(EpisodeEnd end);
+};
+
+#endif /* Session_h */
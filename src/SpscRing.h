@@ -0,0 +1,78 @@
+//
+//  SpscRing.h
+//  PID
+//
+// Bounded lock free ring buffer for one producer thread and one
+// consumer thread. Push never blocks: it returns false when the ring
+// is full so the caller can count the drop and move on.
+//
+
+#ifndef SpscRing_h
+#define SpscRing_h
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+template <typename T>
+class SpscRing {
+    // storage, capacity is a power of two
+    std::vector<T> buffer;
+    size_t mask;
+    
+    // next slot to write, owned by the producer
+    std::atomic<size_t> head;
+    
+    // keep head and tail on separate cache lines
+    char padding[64 - sizeof(std::atomic<size_t>)];
+    
+    // next slot to read, owned by the consumer
+    std::atomic<size_t> tail;
+    
+public:
+    /*
+     * Constructor. Capacity is rounded up to a power of two.
+     */
+    SpscRing(size_t capacity): head(0), tail(0) {
+        size_t size = 1;
+        while(size < capacity)
+            size <<= 1;
+        buffer.resize(size);
+        mask = size - 1;
+    }
+    
+    /*
+     * Add an item. Returns false if the ring is full.
+     */
+    bool Push(const T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h - tail.load(std::memory_order_acquire) > mask)
+            return false;
+        buffer[h & mask] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    
+    /*
+     * Remove up to max items into out. Returns the number removed.
+     */
+    size_t Pop(T *out, size_t max) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t n = head.load(std::memory_order_acquire) - t;
+        if(n > max)
+            n = max;
+        for(size_t i=0; i<n; i++)
+            out[i] = buffer[(t + i) & mask];
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+    
+    /*
+     * Number of items waiting to be read
+     */
+    size_t Size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+};
+
+#endif /* SpscRing_h */
@@ -0,0 +1,217 @@
+//
+//  Telemetry.cpp
+//  pid
+//
+// Class TelemetryDecoder
+// This class extracts cte, speed and steering angle from a simulator
+// telemetry event. The fast path walks the websocket buffer in place
+// and only the fields the controller needs are converted to doubles.
+//
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.hpp"
+#include "Telemetry.h"
+
+// for convenience
+using json = nlohmann::json;
+using namespace std;
+
+// Event prefix of a telemetry frame with a data object
+static const char telemetryPrefix[] = "42[\"telemetry\",{";
+static const size_t telemetryPrefixLength = sizeof(telemetryPrefix) - 1;
+
+// Longest number the fast path will convert
+static const size_t maxNumberLength = 63;
+
+// Bits used to track which fields have been read
+enum FieldBits {CteBit = 1, SpeedBit = 2, AngleBit = 4, AllBits = 7};
+
+string hasData(string s) {
+    auto found_null = s.find("null");
+    auto b1 = s.find_first_of("[");
+    auto b2 = s.find_last_of("]");
+    if (found_null != string::npos) {
+        return "";
+    }
+    else if (b1 != string::npos && b2 != string::npos) {
+        return s.substr(b1, b2 - b1 + 1);
+    }
+    return "";
+}
+
+string TelemetryEvent(const Telemetry &telemetry, size_t imageBytes) {
+    char buf[160];
+    snprintf(buf, sizeof(buf), "42[\"telemetry\",{\"cte\":\"%.4f\",\"speed\":\"%.4f\",\"steering_angle\":\"%.4f\",\"throttle\":\"0\",\"image\":\"",
+             telemetry.cte, telemetry.speed, telemetry.angle);
+    string event(buf);
+    event.append(imageBytes, 'A');
+    event.append("\"}]");
+    return event;
+}
+
+TelemetryDecoder::TelemetryDecoder(): fastFrames(0), slowFrames(0) {};
+
+TelemetryDecoder::~TelemetryDecoder() {};
+
+// Decode a frame, falling back to json.hpp if the fast path
+// does not recognize it
+FrameType TelemetryDecoder::Decode(const char *data, size_t length, Telemetry &telemetry) {
+    if(FastDecode(data, length, telemetry)) {
+        fastFrames++;
+        return TelemetryFrame;
+    }
+    slowFrames++;
+    return SlowDecode(data, length, telemetry);
+}
+
+// Walk the telemetry object key by key. Fields other than cte, speed
+// and steering_angle are skipped without being copied. The walk stops
+// as soon as the three fields have been read so the camera image that
+// trails the object is never touched.
+bool TelemetryDecoder::FastDecode(const char *data, size_t length, Telemetry &telemetry) {
+    if(length < telemetryPrefixLength || memcmp(data, telemetryPrefix, telemetryPrefixLength) != 0)
+        return false;
+
+    int found = 0;
+    size_t i = telemetryPrefixLength;
+    while(i < length) {
+        // key
+        if(data[i] != '"')
+            return false;
+        size_t keyStart = ++i;
+        while(i < length && data[i] != '"') {
+            if(data[i] == '\\')
+                return false;
+            i++;
+        }
+        if(i >= length)
+            return false;
+        size_t keyLength = i - keyStart;
+        const char *key = data + keyStart;
+        i++;
+        if(i >= length || data[i] != ':')
+            return false;
+        i++;
+
+        // value
+        bool ok;
+        if(keyLength == 3 && memcmp(key, "cte", 3) == 0) {
+            ok = ReadNumber(data, length, i, telemetry.cte);
+            found |= CteBit;
+        } else if(keyLength == 5 && memcmp(key, "speed", 5) == 0) {
+            ok = ReadNumber(data, length, i, telemetry.speed);
+            found |= SpeedBit;
+        } else if(keyLength == 14 && memcmp(key, "steering_angle", 14) == 0) {
+            ok = ReadNumber(data, length, i, telemetry.angle);
+            found |= AngleBit;
+        } else {
+            ok = SkipValue(data, length, i);
+        }
+        if(!ok)
+            return false;
+        if(found == AllBits)
+            return true;
+
+        // separator
+        if(i >= length || data[i] != ',')
+            return false;
+        i++;
+    }
+    return false;
+}
+
+// Read a number, which the simulator sends as a quoted string, into
+// value. The digits are copied to a stack buffer so strtod sees a
+// terminated string.
+bool TelemetryDecoder::ReadNumber(const char *data, size_t length, size_t &i, double &value) {
+    bool quoted = (i < length && data[i] == '"');
+    if(quoted)
+        i++;
+
+    size_t start = i;
+    while(i < length && (isdigit((unsigned char)data[i]) || data[i] == '-' || data[i] == '+' ||
+                         data[i] == '.' || data[i] == 'e' || data[i] == 'E'))
+        i++;
+
+    size_t n = i - start;
+    if(n == 0 || n > maxNumberLength)
+        return false;
+    if(quoted) {
+        if(i >= length || data[i] != '"')
+            return false;
+        i++;
+    }
+
+    char buf[maxNumberLength + 1];
+    memcpy(buf, data + start, n);
+    buf[n] = '\0';
+    char *end;
+    value = strtod(buf, &end);
+    return end == buf + n;
+}
+
+// Skip over a value. Strings are scanned with memchr since the
+// image field can be tens of kilobytes.
+bool TelemetryDecoder::SkipValue(const char *data, size_t length, size_t &i) {
+    int depth = 0;
+    while(i < length) {
+        char c = data[i];
+        if(c == '"') {
+            i++;
+            while(true) {
+                const char *q = (const char *)memchr(data + i, '"', length - i);
+                if(q == nullptr)
+                    return false;
+                // count the backslashes in front of the quote
+                size_t k = q - data;
+                size_t slashes = 0;
+                while(k - slashes > i && data[k - slashes - 1] == '\\')
+                    slashes++;
+                i = k + 1;
+                if(slashes % 2 == 0)
+                    break;
+            }
+            if(depth == 0)
+                return true;
+            continue;
+        }
+        if(c == '{' || c == '[') {
+            depth++;
+        } else if(c == '}' || c == ']') {
+            if(depth == 0)
+                return true;
+            depth--;
+            if(depth == 0) {
+                i++;
+                return true;
+            }
+        } else if(c == ',' && depth == 0) {
+            return true;
+        }
+        i++;
+    }
+    return false;
+}
+
+// Original decoding path using hasData and json.hpp
+FrameType TelemetryDecoder::SlowDecode(const char *data, size_t length, Telemetry &telemetry) {
+    auto s = hasData(string(data, length));
+    if (s == "")
+        return ManualFrame;
+
+    auto j = json::parse(s);
+    string event = j[0].get<string>();
+    if (event != "telemetry")
+        return OtherFrame;
+
+    // j[1] is the data JSON object
+    telemetry.cte = stod(j[1]["cte"].get<string>());
+    telemetry.speed = stod(j[1]["speed"].get<string>());
+    telemetry.angle = 0.;
+    if (j[1].find("steering_angle") != j[1].end())
+        telemetry.angle = stod(j[1]["steering_angle"].get<string>());
+    return TelemetryFrame;
+}
@@ -0,0 +1,91 @@
+//
+//  Telemetry.h
+//  PID
+//
+// Decoder for the simulator telemetry event. The common
+// 42["telemetry",{...}] frame is read directly out of the websocket
+// buffer without any heap allocation. Anything the fast path does not
+// recognize is handed to the json.hpp parser.
+//
+
+#ifndef Telemetry_h
+#define Telemetry_h
+
+#include <string>
+#include <stddef.h>
+
+enum FrameType {TelemetryFrame, ManualFrame, OtherFrame};
+
+/*
+ * Values read from a telemetry frame
+ */
+struct Telemetry {
+    double cte;
+    double speed;
+    double angle;
+};
+
+/*
+ * Checks if the SocketIO event has JSON data.
+ * If there is data the JSON object in string format will be returned,
+ * else the empty string "" will be returned.
+ */
+std::string hasData(std::string s);
+
+/*
+ * Telemetry event as the simulator sends it, with an image field of
+ * imageBytes characters standing in for the camera frame
+ */
+std::string TelemetryEvent(const Telemetry &telemetry, size_t imageBytes = 0);
+
+class TelemetryDecoder {
+    /*
+     * Read a quoted or bare number starting at data[i]
+     */
+    bool ReadNumber(const char *data, size_t length, size_t &i, double &value);
+
+    /*
+     * Skip a JSON value (string, number, literal or nested object/array)
+     */
+    bool SkipValue(const char *data, size_t length, size_t &i);
+
+public:
+    /*
+     * Number of frames decoded by the allocation free path
+     */
+    unsigned long fastFrames;
+
+    /*
+     * Number of frames handed to the json.hpp parser
+     */
+    unsigned long slowFrames;
+
+    /*
+     * Constructor
+     */
+    TelemetryDecoder();
+
+    /*
+     * Destructor.
+     */
+    virtual ~TelemetryDecoder();
+
+    /*
+     * Decode a "42" websocket event. Returns the frame type and,
+     * for TelemetryFrame, fills in telemetry.
+     */
+    FrameType Decode(const char *data, size_t length, Telemetry &telemetry);
+
+    /*
+     * Allocation free decoder. Returns false if the frame is not a
+     * well formed telemetry object.
+     */
+    bool FastDecode(const char *data, size_t length, Telemetry &telemetry);
+
+    /*
+     * Decode using hasData and json.hpp
+     */
+    FrameType SlowDecode(const char *data, size_t length, Telemetry &telemetry);
+};
+
+#endif /* Telemetry_h */
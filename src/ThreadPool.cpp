@@ -0,0 +1,116 @@
+//
+//  ThreadPool.cpp
+//  pid
+//
+// Class ThreadPool
+// Workers take tasks from a shared queue. ParallelFor hands out loop
+// indices through an atomic counter so each worker keeps pulling
+// indices until the loop is exhausted.
+//
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include "ThreadPool.h"
+
+using namespace std;
+
+// pool whose worker is the calling thread, nullptr off the pool
+static thread_local ThreadPool *currentPool = nullptr;
+
+ThreadPool::ThreadPool(int size): stopping(false) {
+    if(size <= 0)
+        size = thread::hardware_concurrency();
+    if(size <= 0)
+        size = 1;
+    for(int i=0; i<size; i++)
+        workers.push_back(thread(&ThreadPool::Work, this));
+};
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for(auto &worker : workers)
+        worker.join();
+};
+
+int ThreadPool::Size() {
+    return int(workers.size());
+}
+
+// Run tasks until the pool is stopped and the queue is empty
+void ThreadPool::Work() {
+    currentPool = this;
+    while(true) {
+        function<void()> task;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if(tasks.empty())
+                return;
+            task = tasks.front();
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::Submit(const function<void()> &task) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        tasks.push(task);
+    }
+    available.notify_one();
+}
+
+// Start one task per worker (or per index if fewer) and wait on a
+// counter of finished tasks. The first exception thrown by body stops
+// the loop and is rethrown here. Called from one of this pool's own
+// workers the loop runs inline, since waiting there could deadlock.
+void ThreadPool::ParallelFor(int n, const function<void(int)> &body) {
+    if(n <= 0)
+        return;
+    if(currentPool == this) {
+        for(int i=0; i<n; i++)
+            body(i);
+        return;
+    }
+    
+    struct Loop {
+        atomic<int> next;
+        int running;
+        exception_ptr error;
+        std::mutex mutex;
+        condition_variable done;
+    };
+    shared_ptr<Loop> loop = make_shared<Loop>();
+    loop->next = 0;
+    int numTasks = n < Size() ? n : Size();
+    loop->running = numTasks;
+    
+    for(int t=0; t<numTasks; t++) {
+        Submit([loop, n, &body] {
+            exception_ptr error;
+            try {
+                for(int i = loop->next++; i < n; i = loop->next++)
+                    body(i);
+            } catch(...) {
+                error = current_exception();
+                loop->next = n;
+            }
+            lock_guard<std::mutex> lock(loop->mutex);
+            if(error && !loop->error)
+                loop->error = error;
+            if(--loop->running == 0)
+                loop->done.notify_all();
+        });
+    }
+    
+    unique_lock<std::mutex> lock(loop->mutex);
+    loop->done.wait(lock, [&loop] { return loop->running == 0; });
+    if(loop->error)
+        rethrow_exception(loop->error);
+}
@@ -0,0 +1,67 @@
+//
+//  ThreadPool.h
+//  PID
+//
+// Fixed size pool of worker threads used to run gain evaluations
+// concurrently.
+//
+
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    // worker threads
+    std::vector<std::thread> workers;
+    
+    // pending tasks
+    std::queue<std::function<void()> > tasks;
+    
+    // guards tasks and stopping
+    std::mutex mutex;
+    std::condition_variable available;
+    
+    // set when the pool is destroyed
+    bool stopping;
+    
+    /*
+     * Worker loop
+     */
+    void Work();
+    
+public:
+    /*
+     * Constructor. A size of 0 uses one thread per hardware thread.
+     */
+    ThreadPool(int size = 0);
+    
+    /*
+     * Destructor. Waits for queued tasks to finish.
+     */
+    virtual ~ThreadPool();
+    
+    /*
+     * Number of worker threads
+     */
+    int Size();
+    
+    /*
+     * Queue a task
+     */
+    void Submit(const std::function<void()> &task);
+    
+    /*
+     * Run body(i) for i = 0..n-1 on the pool and wait for all of them.
+     * The first exception thrown by body is rethrown on the caller.
+     * Called from a worker of this pool, the loop runs on that worker.
+     */
+    void ParallelFor(int n, const std::function<void(int)> &body);
+};
+
+#endif /* ThreadPool_h */
@@ -8,7 +8,10 @@
 // This class is used to optimize the parameter list p to a given tolerance
 //
 #include <iostream>
+#include <vector>
 #include <math.h>
+#include "Evaluator.h"
+#include "ThreadPool.h"
 #include "Twiddle.h"
 
 using namespace std;
@@ -140,6 +143,90 @@ bool Twiddle::Update() {
 
 }
 
+// One batched Twiddle cycle. Update tries p(i)+dp(i) and then
+// p(i)-dp(i) one parameter at a time; here all 2*p_num probes are
+// evaluated at once around the current p. Each parameter keeps the
+// direction that beat best_error (growing dp) or shrinks dp. When
+// several parameters improve, the combined step is evaluated and kept
+// if it beats the best single probe.
+bool Twiddle::UpdateBatch(GainEvaluator &evaluator, ThreadPool &pool) {
+    if(check == Initialize) {
+        // First time to call Twiddle...set best_error
+        best_error = evaluator.Evaluate(p);
+        error = best_error;
+        check = CheckDp;
+    }
+    
+    // If ||dp|| is small then Twiddle is done
+    magDp = Magnitued(dp);
+    std::cout << "batch ||dp|| " << magDp << std::endl;
+    if( magDp < tolerance) {
+        check = Done;
+        return true;
+    }
+    
+    // Probe k = 2*i is p + dp(i), probe k = 2*i+1 is p - dp(i)
+    int numProbes = 2*p_num;
+    vector<double> probes(numProbes*p_num);
+    vector<double> errors(numProbes);
+    for(int k=0; k<numProbes; k++) {
+        double *probe = &probes[k*p_num];
+        for(int j=0; j<p_num; j++)
+            probe[j] = p[j];
+        int i = k/2;
+        probe[i] += (k % 2 == 0) ? dp[i] : -dp[i];
+    }
+    pool.ParallelFor(numProbes, [&](int k) {
+        bool complete;
+        errors[k] = evaluator.Evaluate(&probes[k*p_num], best_error, complete);
+    });
+    
+    // Accept, expand or shrink each parameter against the current best
+    vector<double> step(p_num, 0.);
+    int numAccepted = 0;
+    int bestProbe = -1;
+    for(int i=0; i<p_num; i++) {
+        int k = -1;
+        if(errors[2*i] < best_error)
+            k = 2*i;
+        else if(errors[2*i+1] < best_error)
+            k = 2*i+1;
+        
+        if(k >= 0) {
+            step[i] = (k % 2 == 0) ? dp[i] : -dp[i];
+            dp[i] *= 1.1;
+            numAccepted++;
+            if(bestProbe < 0 || errors[k] < errors[bestProbe])
+                bestProbe = k;
+        } else {
+            dp[i] *= 0.9;
+        }
+    }
+    
+    if(numAccepted == 0)
+        return false;
+    
+    // Move to the best single probe, or to the combined step if better
+    double *best = &probes[bestProbe*p_num];
+    double bestError = errors[bestProbe];
+    vector<double> combined(p_num);
+    if(numAccepted > 1) {
+        for(int j=0; j<p_num; j++)
+            combined[j] = p[j] + step[j];
+        bool complete;
+        double combinedError = evaluator.Evaluate(&combined[0], bestError, complete);
+        if(combinedError < bestError) {
+            best = &combined[0];
+            bestError = combinedError;
+        }
+    }
+    for(int j=0; j<p_num; j++)
+        p[j] = best[j];
+    best_error = bestError;
+    error = bestError;
+    return false;
+}
+
 // Method to get the magnitude of dp
 double Twiddle::Magnitued(double *dp) {
     double sum = 0;
@@ -151,12 +238,36 @@ double Twiddle::Magnitued(double *dp) {
 // Set Twiddle error based on accumulated error
 // min steps and actual steps.
 void Twiddle::SetError(double inError, int minSteps, int actualSteps) {
-    if(actualSteps <= minSteps) {
-        error = 1.e9;
-    } else {
-        // normalize the error by the number of steps since
-        // the number of steps can vary
-        error = inError/float(actualSteps-minSteps);
-    }
+    error = NormalizeError(inError, minSteps, actualSteps);
 }
 
+// Normalize the error by the number of steps since
+// the number of steps can vary
+double Twiddle::NormalizeError(double inError, int minSteps, int actualSteps) {
+    if(actualSteps <= minSteps)
+        return 1.e9;
+    return inError/float(actualSteps-minSteps);
+}
+
+// Heuristic estimate of the final normalized error: the error so far,
+// which can only grow, spread over a guess of all the steps of the lap.
+// The rest of the lap is guessed at slack times the steps per mile of
+// the actualSteps + 1 frames so far (the Start frame is not a call). It
+// is not a bound: a lap that slows down more than slack allows ends with
+// a lower error, so a lap stopped on this estimate may have been good.
+double Twiddle::ProjectedError(double inError, int minSteps, int actualSteps, double fraction, double slack) {
+    if(fraction <= 0.)
+        return 0.;
+    double frames = actualSteps + 1;
+    double projectedSteps = actualSteps + slack*fmax(frames/fraction - frames, 0.);
+    if(projectedSteps <= minSteps)
+        return 0.;
+    return inError/(projectedSteps - minSteps);
+}
+
+// Best error so far, once Update or UpdateBatch has set it
+double Twiddle::Incumbent() {
+    if(check == Initialize)
+        return HUGE_VAL;
+    return best_error;
+}
@@ -10,6 +10,9 @@
 
 #include "PID.h"
 
+class GainEvaluator;
+class ThreadPool;
+
 enum Step {Initialize, CheckDp, NextIndex, Forward, Backward, Done};
 
 class Twiddle {
@@ -81,6 +84,13 @@ public:
      * Update the parameters using Twiddle algorithm
      */
     bool Update();
+    
+    /*
+     * Batched Twiddle cycle. Evaluates the +dp and -dp probes of every
+     * parameter concurrently, then applies the Update accept, expand
+     * and shrink rules to each parameter. Returns true if tolerance is met.
+     */
+    bool UpdateBatch(GainEvaluator &evaluator, ThreadPool &pool);
 
     /*
      * Get the magnitude of an array
@@ -91,6 +101,24 @@ public:
      * Set Twiddle error
      */
     void SetError(double error, int minSteps, int actualSteps);
+    
+    /*
+     * Normalize accumulated error by the number of steps
+     * it was accumulated over
+     */
+    static double NormalizeError(double error, int minSteps, int actualSteps);
+    
+    /*
+     * Estimate of the normalized error of a lap that is fraction
+     * complete after actualSteps PID calls, guessing that the rest of
+     * the lap takes slack times the steps per mile so far. Not a bound.
+     */
+    static double ProjectedError(double error, int minSteps, int actualSteps, double fraction, double slack);
+    
+    /*
+     * Error a new probe has to beat, HUGE_VAL before the first error
+     */
+    double Incumbent();
 };
 
 #endif /* Twiddle_h */
@@ -0,0 +1,330 @@
+//
+//  bench-controller.cpp
+//  PID
+//
+// Control quality and throughput of the steering and throttle
+// controllers on a fixed set of scenarios. Each synthetic scenario
+// drives the plant closed loop through Session for a fixed number of
+// frames; recorded logs are replayed open loop. The telemetry text of
+// every frame is then pushed through decode, Control and encode again
+// to time the frame path, and the cte sequence through a lone PID to
+// time ControlOutput. Results are written as JSON.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.hpp"
+#include "ControlMessage.h"
+#include "PID.h"
+#include "Plant.h"
+#include "Recorder.h"
+#include "Session.h"
+#include "Telemetry.h"
+
+// for convenience
+using json = nlohmann::json;
+using namespace std;
+
+// Initial PID gains {Kp, Ki, Kd}
+static const double steerGains[3] = {0.2113, 0.0026, 21.5840};
+static const double throttleGains[3] = {0.1000, 0.0001, -0.0274};
+
+// |cte| band the car has settled into (meters), and the cte that
+// counts as leaving the track
+static const double settleBand = 0.2;
+static const double cteMax = 3.;
+
+/*
+ * Synthetic scenario: a track, plant changes and start state
+ */
+struct Scenario {
+    const char *name;
+    Track track;
+    double steerLag;
+    double startCte;
+    double startSpeed;
+};
+
+/*
+ * cte, speed and commands of every frame of a run
+ */
+struct Run {
+    vector<double> cte;
+    vector<double> speed;
+    vector<string> frames;
+    uint64_t commandHash;
+    bool crashed;
+    double dt;
+};
+
+// FNV-1a over the bits of the commands, so any change in the outputs
+// shows up even when the summary statistics round the same
+static void HashDouble(uint64_t &hash, double value) {
+    unsigned char bytes[sizeof(double)];
+    memcpy(bytes, &value, sizeof(double));
+    for(size_t i=0; i<sizeof(double); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+// Closed loop run of the plant. The controllers see the telemetry as
+// decoded from its text so the run matches what the simulator path does.
+static Run DriveScenario(const Scenario &scenario, int numFrames) {
+    Run run;
+    run.commandHash = 14695981039346656037ull;
+    run.crashed = false;
+
+    Plant car(scenario.track);
+    car.steerLag = scenario.steerLag;
+    car.Reset(scenario.startCte, scenario.startSpeed);
+    run.dt = car.dt;
+
+    Session session(0, steerGains, throttleGains);
+    session.maxDistance = HUGE_VAL;
+    for(int k=0; k<numFrames; k++) {
+        string text = TelemetryEvent(car.Sense());
+        Telemetry telemetry;
+        session.decoder.Decode(text.data(), text.length(), telemetry);
+        double steerValue, throttleValue;
+        session.Control(telemetry, steerValue, throttleValue);
+        HashDouble(run.commandHash, steerValue);
+        HashDouble(run.commandHash, throttleValue);
+        car.Step(steerValue, throttleValue);
+
+        run.cte.push_back(telemetry.cte);
+        run.speed.push_back(telemetry.speed);
+        run.frames.push_back(text);
+        if(fabs(telemetry.cte) > cteMax) {
+            run.crashed = true;
+            break;
+        }
+    }
+    return run;
+}
+
+// Open loop replay of the telemetry in a log
+static bool ReplayLog(const string &filename, Run &run) {
+    LogReader log;
+    if(!log.Open(filename))
+        return false;
+    run.commandHash = 14695981039346656037ull;
+    run.crashed = false;
+    run.dt = 0.1;
+
+    Session session(0, steerGains, throttleGains);
+    session.maxDistance = HUGE_VAL;
+    for(size_t i=0; i<log.count; i++) {
+        const LogRecord &record = log.records[i];
+        if(record.kind == EpisodeRecord)
+            session.EndEpisode(EpisodeEnd(int(record.value[2])));
+        if(record.kind != TelemetryRecord)
+            continue;
+        Telemetry telemetry;
+        telemetry.cte = record.value[0];
+        telemetry.speed = record.value[1];
+        telemetry.angle = record.value[2];
+        double steerValue, throttleValue;
+        session.Control(telemetry, steerValue, throttleValue);
+        HashDouble(run.commandHash, steerValue);
+        HashDouble(run.commandHash, throttleValue);
+        run.cte.push_back(telemetry.cte);
+        run.speed.push_back(telemetry.speed);
+        run.frames.push_back(TelemetryEvent(telemetry));
+    }
+    return true;
+}
+
+// Quality of a run: rms and max cte, when |cte| last left the settle
+// band, and the rms speed error
+static json Quality(const Run &run, double setSpeed) {
+    double sum2 = 0.;
+    double maxCte = 0.;
+    double speed2 = 0.;
+    int settled = 0;
+    for(size_t k=0; k<run.cte.size(); k++) {
+        double cte = run.cte[k];
+        sum2 += cte*cte;
+        maxCte = fmax(maxCte, fabs(cte));
+        speed2 += (run.speed[k] - setSpeed)*(run.speed[k] - setSpeed);
+        if(fabs(cte) > settleBand)
+            settled = int(k) + 1;
+    }
+    double n = fmax(1., double(run.cte.size()));
+    json q;
+    q["frames"] = run.cte.size();
+    q["crashed"] = run.crashed;
+    q["rms_cte"] = sqrt(sum2/n);
+    q["max_cte"] = maxCte;
+    q["rms_speed_error"] = sqrt(speed2/n);
+    if(run.crashed || settled >= int(run.cte.size()))
+        q["settling_time_s"] = nullptr;
+    else
+        q["settling_time_s"] = settled*run.dt;
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)run.commandHash);
+    q["command_hash"] = hash;
+    return q;
+}
+
+// Best of repeat timings of the frame path and of ControlOutput
+static json Throughput(const Run &run, int repeat) {
+    double bestFrameNs = HUGE_VAL;
+    double bestControlNs = HUGE_VAL;
+    double checksum = 0.;
+    size_t n = run.frames.size();
+    for(int r=0; r<repeat && n>0; r++) {
+        // decode, Control and encode
+        Session session(0, steerGains, throttleGains);
+        session.maxDistance = HUGE_VAL;
+        auto start = chrono::steady_clock::now();
+        for(size_t k=0; k<n; k++) {
+            const string &text = run.frames[k];
+            Telemetry telemetry;
+            session.decoder.Decode(text.data(), text.length(), telemetry);
+            double steerValue, throttleValue;
+            session.Control(telemetry, steerValue, throttleValue);
+            checksum += session.encoder.Encode(steerValue, throttleValue);
+        }
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/n;
+        bestFrameNs = fmin(bestFrameNs, ns);
+
+        // steering ControlOutput alone
+        double gains[3] = {steerGains[0], steerGains[1], steerGains[2]};
+        double bounds[2] = {-1., 1.};
+        double setPoint = 0.;
+        int n2error = 100;
+        PID pid;
+        pid.Init(gains, bounds, &setPoint, &n2error);
+        pid.Start(run.cte[0]);
+        start = chrono::steady_clock::now();
+        for(size_t k=1; k<n; k++)
+            checksum += pid.ControlOutput(run.cte[k]);
+        ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/fmax(1., double(n - 1));
+        bestControlNs = fmin(bestControlNs, ns);
+    }
+    json t;
+    t["frames_per_second"] = 1.e9/bestFrameNs;
+    t["ns_per_frame"] = bestFrameNs;
+    t["ns_per_control_output"] = bestControlNs;
+    t["checksum"] = checksum;
+    return t;
+}
+
+// Add the timings of the same scenarios in a baseline report to each
+// entry and print a before/after table to stderr. The command hashes
+// must match, otherwise the two builds do not compute the same thing.
+static bool Compare(json &report, const string &filename) {
+    ifstream in(filename);
+    if(!in)
+        return false;
+    json baseline;
+    in >> baseline;
+    
+    bool identical = true;
+    fprintf(stderr, "%-16s %12s %12s %8s %12s %12s %8s  %s\n", "scenario", "frame ns", "baseline", "speedup",
+            "control ns", "baseline", "speedup", "commands");
+    for(json &entry : report["scenarios"]) {
+        for(const json &base : baseline["scenarios"]) {
+            if(base["name"] != entry["name"])
+                continue;
+            double frameNs = entry["throughput"]["ns_per_frame"];
+            double baseFrameNs = base["throughput"]["ns_per_frame"];
+            double controlNs = entry["throughput"]["ns_per_control_output"];
+            double baseControlNs = base["throughput"]["ns_per_control_output"];
+            bool same = (entry["quality"]["command_hash"] == base["quality"]["command_hash"]);
+            identical = identical && same;
+            json b;
+            b["ns_per_frame"] = baseFrameNs;
+            b["ns_per_control_output"] = baseControlNs;
+            b["frame_speedup"] = baseFrameNs/frameNs;
+            b["control_output_speedup"] = baseControlNs/controlNs;
+            b["same_commands"] = same;
+            entry["baseline"] = b;
+            string name = entry["name"];
+            fprintf(stderr, "%-16s %12.1f %12.1f %7.2fx %12.2f %12.2f %7.2fx  %s\n", name.c_str(), frameNs, baseFrameNs,
+                    baseFrameNs/frameNs, controlNs, baseControlNs, baseControlNs/controlNs, same ? "same" : "DIFFERENT");
+        }
+    }
+    report["same_commands_as_baseline"] = identical;
+    return true;
+}
+
+// Usage: bench-controller [--frames n] [--repeat n] [--compare baseline.json] [log ...]
+//   --frames n    frames driven per synthetic scenario (default 3000)
+//   --repeat n    timing repeats, the fastest is reported (default 20)
+//   --compare f   report speedups against an earlier report written by bench-controller
+//   log           recorded telemetry replayed as an extra scenario
+int main(int argc, char *argv[])
+{
+    int numFrames = 3000;
+    int repeat = 20;
+    vector<string> logs;
+    string baselineFile;
+    for(int i=1; i<argc; i++) {
+        string arg = argv[i];
+        if(arg == "--frames" && i+1 < argc)
+            numFrames = atoi(argv[++i]);
+        else if(arg == "--repeat" && i+1 < argc)
+            repeat = atoi(argv[++i]);
+        else if(arg == "--compare" && i+1 < argc)
+            baselineFile = argv[++i];
+        else
+            logs.push_back(arg);
+    }
+
+    // Fixed synthetic scenarios
+    vector<Scenario> scenarios = {
+        {"oval", Track::Oval(300., 80., 1.), 0.1, 0.7598, 0.},
+        {"oval-offset", Track::Oval(300., 80., 1.), 0.1, 1.5, 0.},
+        {"tight-oval", Track::Oval(100., 30., 1.), 0.1, 0.7598, 0.},
+        {"wavy", Track::Wavy(150., 0.15, 5, 1.), 0.1, 0.7598, 0.},
+        {"slow-steering", Track::Oval(300., 80., 1.), 0.25, 0.7598, 0.},
+    };
+
+    // Set points are the Session defaults
+    Session reference(0, steerGains, throttleGains);
+    json report;
+    report["frames_per_scenario"] = numFrames;
+    report["repeat"] = repeat;
+    report["steer_gains"] = {steerGains[0], steerGains[1], steerGains[2]};
+    report["throttle_gains"] = {throttleGains[0], throttleGains[1], throttleGains[2]};
+    report["scenarios"] = json::array();
+    for(const Scenario &scenario : scenarios) {
+        Run run = DriveScenario(scenario, numFrames);
+        json entry;
+        entry["name"] = scenario.name;
+        entry["closed_loop"] = true;
+        entry["quality"] = Quality(run, reference.setSpeed);
+        entry["throughput"] = Throughput(run, repeat);
+        report["scenarios"].push_back(entry);
+    }
+    for(const string &filename : logs) {
+        Run run;
+        if(!ReplayLog(filename, run)) {
+            cerr << "Failed to open log " << filename << endl;
+            return -1;
+        }
+        json entry;
+        entry["name"] = filename;
+        entry["closed_loop"] = false;
+        entry["quality"] = Quality(run, reference.setSpeed);
+        entry["throughput"] = Throughput(run, repeat);
+        report["scenarios"].push_back(entry);
+    }
+    if(!baselineFile.empty() && !Compare(report, baselineFile)) {
+        cerr << "Failed to read baseline " << baselineFile << endl;
+        return -1;
+    }
+    cout << report.dump(2) << endl;
+    return 0;
+}
@@ -0,0 +1,100 @@
+//
+//  bench-encoder.cpp
+//  PID
+//
+// Micro-benchmark of the steer reply. Times the original json::dump
+// path against ControlEncoder and checks that every encoder message
+// parses with json.hpp back to exactly the doubles encoded. Messages
+// identical to json::dump are counted but not required.
+//
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <string.h>
+#include "json.hpp"
+#include "ControlMessage.h"
+
+// for convenience
+using json = nlohmann::json;
+using namespace std;
+
+// Original reply formatting from main.cpp
+string jsonMessage(double steerValue, double throttleValue) {
+    json msgJson;
+    msgJson["steering_angle"] = steerValue;
+    msgJson["throttle"] = throttleValue;
+    return "42[\"steer\"," + msgJson.dump() + "]";
+}
+
+int main(int argc, char *argv[])
+{
+    int n = 1000000;
+    if(argc > 1)
+        n = atoi(argv[1]);
+
+    // Controller outputs are clamped to [-1, 1], include the
+    // bounds, zero and a few values that are exactly integers
+    mt19937 gen(42);
+    uniform_real_distribution<double> uniform(-1., 1.);
+    vector<double> steer(n), throttle(n);
+    for(int i=0; i<n; i++) {
+        steer[i] = uniform(gen);
+        throttle[i] = uniform(gen);
+    }
+    double special[] = {0., -0., 1., -1., 0.3, 0.1 + 0.2, 1.e-7};
+    for(int i=0; i<7 && i<n; i++)
+        steer[i] = special[i];
+
+    // Every message must parse back to the values encoded, with the
+    // sign of zero kept
+    ControlEncoder encoder;
+    int identical = 0;
+    int roundTrip = 0;
+    for(int i=0; i<n; i++) {
+        string expected = jsonMessage(steer[i], throttle[i]);
+        size_t length = encoder.Encode(steer[i], throttle[i]);
+        json j;
+        try {
+            j = json::parse(string(encoder.buffer + 2, length - 2));
+        } catch(const exception &e) {
+            cerr << "Unparsable: " << encoder.buffer << ": " << e.what() << endl;
+            return -1;
+        }
+        double s = j[1]["steering_angle"].get<double>();
+        double t = j[1]["throttle"].get<double>();
+        if(j[0] != "steer" || s != steer[i] || t != throttle[i] ||
+           signbit(s) != signbit(steer[i]) || signbit(t) != signbit(throttle[i])) {
+            cerr << "Mismatch: " << expected << " vs " << encoder.buffer << endl;
+            return -1;
+        }
+        if(expected.length() == length && memcmp(expected.data(), encoder.buffer, length) == 0)
+            identical++;
+        else
+            roundTrip++;
+    }
+
+    // Time the json::dump path
+    size_t bytes = 0;
+    auto start = chrono::steady_clock::now();
+    for(int i=0; i<n; i++) {
+        auto msg = jsonMessage(steer[i], throttle[i]);
+        bytes += msg.length();
+    }
+    double jsonNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/n;
+
+    // Time the encoder
+    start = chrono::steady_clock::now();
+    for(int i=0; i<n; i++)
+        bytes += encoder.Encode(steer[i], throttle[i]);
+    double encoderNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/n;
+
+    printf("Messages: %d identical: %d more digits: %d (bytes %zu)\n", n, identical, roundTrip, bytes);
+    printf("json::dump      %8.1f ns/message\n", jsonNs);
+    printf("ControlEncoder  %8.1f ns/message\n", encoderNs);
+    printf("Speedup         %8.2fx\n", jsonNs/encoderNs);
+    return 0;
+}
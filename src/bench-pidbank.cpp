@@ -0,0 +1,110 @@
+//
+//  bench-pidbank.cpp
+//  PID
+//
+// Throughput of PIDBank against one PID object per gain set. Both are
+// driven with the same inputs and every output and accumulated error
+// is checked for bitwise equality.
+//
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <string.h>
+#include "PID.h"
+#include "PIDBank.h"
+
+using namespace std;
+
+// Usage: bench-pidbank [controllers] [steps]
+int main(int argc, char *argv[])
+{
+    int n = 4096;
+    int steps = 2000;
+    if(argc > 1)
+        n = atoi(argv[1]);
+    if(argc > 2)
+        steps = atoi(argv[2]);
+    
+    // Gain sets scattered around the repo steering gains, with some
+    // outputs large enough to hit the bounds
+    mt19937 gen(42);
+    uniform_real_distribution<double> scale(0.5, 2.);
+    normal_distribution<double> noise(0., 0.05);
+    vector<double> gains(3*n);
+    double bounds[2] = {-1., 1.};
+    double setPoint = 0.;
+    vector<int> n2error(n);
+    for(int i=0; i<n; i++) {
+        gains[3*i] = 0.2113*scale(gen);
+        gains[3*i+1] = 0.0026*scale(gen);
+        gains[3*i+2] = 21.5840*scale(gen);
+        n2error[i] = i % 50;
+    }
+    
+    // Cross track errors: a slow oscillation per controller plus noise
+    vector<double> input((steps + 1)*size_t(n));
+    for(int k=0; k<=steps; k++)
+        for(int i=0; i<n; i++)
+            input[size_t(k)*n + i] = 0.8*sin(0.01*k + 0.001*i) + noise(gen);
+    
+    vector<PID> pids(n);
+    PIDBank bank(n);
+    for(int i=0; i<n; i++) {
+        pids[i].Init(&gains[3*i], bounds, &setPoint, &n2error[i]);
+        bank.Init(i, &gains[3*i], bounds, setPoint, n2error[i]);
+    }
+    vector<double> scalarOut(n), bankOut(n);
+    
+    // Check agreement
+    for(int i=0; i<n; i++)
+        pids[i].Start(input[i]);
+    bank.Start(&input[0]);
+    for(int k=1; k<=steps; k++) {
+        const double *in = &input[size_t(k)*n];
+        for(int i=0; i<n; i++)
+            scalarOut[i] = pids[i].ControlOutput(in[i]);
+        bank.ControlOutput(in, &bankOut[0]);
+        if(memcmp(&scalarOut[0], &bankOut[0], n*sizeof(double)) != 0) {
+            cerr << "Output mismatch at step " << k << endl;
+            return -1;
+        }
+    }
+    for(int i=0; i<n; i++) {
+        double a = pids[i].GetError();
+        double b = bank.GetError(i);
+        if(memcmp(&a, &b, sizeof(double)) != 0) {
+            cerr << "Accumulated error mismatch for controller " << i << endl;
+            return -1;
+        }
+    }
+    
+    // Time one PID per gain set
+    double sum = 0.;
+    for(int i=0; i<n; i++)
+        pids[i].Start(input[i]);
+    auto start = chrono::steady_clock::now();
+    for(int k=1; k<=steps; k++) {
+        const double *in = &input[size_t(k)*n];
+        for(int i=0; i<n; i++)
+            scalarOut[i] = pids[i].ControlOutput(in[i]);
+        sum += scalarOut[k % n];
+    }
+    double scalarNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/(double(n)*steps);
+    
+    // Time the bank
+    bank.Start(&input[0]);
+    start = chrono::steady_clock::now();
+    for(int k=1; k<=steps; k++) {
+        bank.ControlOutput(&input[size_t(k)*n], &bankOut[0]);
+        sum += bankOut[k % n];
+    }
+    double bankNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/(double(n)*steps);
+    
+    printf("Controllers: %d steps: %d identical outputs (checksum %g)\n", n, steps, sum);
+    printf("PID      %8.3f ns/update  %8.1f M updates/s\n", scalarNs, 1.e3/scalarNs);
+    printf("PIDBank  %8.3f ns/update  %8.1f M updates/s\n", bankNs, 1.e3/bankNs);
+    printf("Speedup  %8.2fx\n", scalarNs/bankNs);
+    return 0;
+}
@@ -0,0 +1,266 @@
+#include <uWS/uWS.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Histogram.h"
+#include "Plant.h"
+#include "Recorder.h"
+#include "Telemetry.h"
+
+using namespace std;
+
+/*
+ * One simulated simulator connection
+ */
+struct Connection {
+    // connection number
+    int id;
+
+    // car driven by the replies in synthetic mode
+    Plant car;
+
+    // next telemetry record in replay mode
+    size_t next;
+
+    // time the outstanding frame was sent (ns)
+    uint64_t sentAt;
+
+    // frames answered
+    unsigned long frames;
+
+    Connection(int id, const Track &track): id(id), car(track), next(0), sentAt(0), frames(0) {};
+};
+
+/*
+ * Counters shared by the handlers and the report timer
+ */
+struct LoadStats {
+    // round trip times of frames answered after the warmup (ns)
+    Histogram rtt;
+
+    // measurement window and last progress line (ns)
+    uint64_t measureFrom;
+    uint64_t measureTo;
+    uint64_t lastReport;
+    uint64_t lastFrames;
+
+    // episode resets sent by the server and reconnections
+    unsigned long resets;
+    unsigned long reconnects;
+
+    // connections asked for, open and failed
+    int connections;
+    int open;
+    int failed;
+
+    LoadStats(): measureFrom(0), measureTo(0), lastReport(0), lastFrames(0), resets(0), reconnects(0),
+        connections(0), open(0), failed(0) {};
+
+    /*
+     * Print throughput and round trip percentiles
+     */
+    void Report() {
+        uint64_t n = rtt.Count();
+        double elapsed = fmax(1.e-9, (LatencyStats::Now() - measureFrom)*1.e-9);
+        printf("Connections %d (%d failed), %lu reconnects, %lu resets\n", connections, failed, reconnects, resets);
+        printf("Frames %llu in %.2f sec: %.0f frames/sec, %.0f frames/sec per connection\n", (unsigned long long)n,
+               elapsed, n/elapsed, n/elapsed/fmax(1., double(connections - failed)));
+        printf("Round trip us: p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n", rtt.Percentile(0.5)*1.e-3,
+               rtt.Percentile(0.9)*1.e-3, rtt.Percentile(0.99)*1.e-3, rtt.Percentile(0.999)*1.e-3, rtt.Max()*1.e-3);
+    }
+};
+
+// Once a second: print throughput, and stop at the end of the run
+static void Tick(uS::Timer *timer) {
+    LoadStats *stats = (LoadStats *)timer->getData();
+    uint64_t now = LatencyStats::Now();
+    if(now >= stats->measureTo) {
+        stats->Report();
+        exit(0);
+    }
+    if(now < stats->measureFrom)
+        return;
+    uint64_t frames = stats->rtt.Count();
+    double interval = fmax(1.e-9, (now - fmax(stats->lastReport, stats->measureFrom))*1.e-9);
+    printf("%6.1f sec %8.0f frames/sec, p99 %8.1f us, %d open\n", (now - stats->measureFrom)*1.e-9,
+           (frames - stats->lastFrames)/interval, stats->rtt.Percentile(0.99)*1.e-3, stats->open);
+    stats->lastFrames = frames;
+    stats->lastReport = now;
+}
+
+// Read the steering_angle and throttle of a steer event
+static bool ParseSteer(const char *data, size_t length, double &steer, double &throttle) {
+    char buf[256];
+    if(length >= sizeof(buf))
+        return false;
+    memcpy(buf, data, length);
+    buf[length] = '\0';
+    const char *s = strstr(buf, "\"steering_angle\":");
+    const char *t = strstr(buf, "\"throttle\":");
+    if(s == nullptr || t == nullptr)
+        return false;
+    steer = strtod(s + strlen("\"steering_angle\":"), nullptr);
+    throttle = strtod(t + strlen("\"throttle\":"), nullptr);
+    return true;
+}
+
+// Simulator stand-in and load generator for pid.
+// Usage: pid-loadgen [--url ws://127.0.0.1:4567] [--connections n] [--seconds s] [--warmup s]
+//                    [--image-bytes n] [--log file] [--track file]
+//   --connections n  concurrent connections, each with one frame in flight (default 1)
+//   --seconds s      measured run time (default 10)
+//   --warmup s       time before measuring starts (default 1)
+//   --image-bytes n  size of the image field of every frame (default 0)
+//   --log file       replay the telemetry of a recorded log, looping, instead of driving the plant
+//   --track file     track centerline for the plant (default oval)
+int main(int argc, char *argv[])
+{
+    uWS::Hub h;
+
+    string url = "ws://127.0.0.1:4567";
+    int numConnections = 1;
+    double seconds = 10.;
+    double warmup = 1.;
+    size_t imageBytes = 0;
+    string logFile;
+    string trackFile;
+    for(int i=1; i<argc; i++) {
+        string arg = argv[i];
+        if(arg == "--url" && i+1 < argc)
+            url = argv[++i];
+        else if(arg == "--connections" && i+1 < argc)
+            numConnections = atoi(argv[++i]);
+        else if(arg == "--seconds" && i+1 < argc)
+            seconds = atof(argv[++i]);
+        else if(arg == "--warmup" && i+1 < argc)
+            warmup = atof(argv[++i]);
+        else if(arg == "--image-bytes" && i+1 < argc)
+            imageBytes = size_t(atol(argv[++i]));
+        else if(arg == "--log" && i+1 < argc)
+            logFile = argv[++i];
+        else if(arg == "--track" && i+1 < argc)
+            trackFile = argv[++i];
+    }
+
+    // Recorded telemetry to replay, if any
+    LogReader log;
+    vector<Telemetry> replay;
+    if(!logFile.empty()) {
+        if(!log.Open(logFile)) {
+            cerr << "Failed to open log " << logFile << endl;
+            return -1;
+        }
+        for(size_t i=0; i<log.count; i++) {
+            const LogRecord &record = log.records[i];
+            if(record.kind == TelemetryRecord) {
+                Telemetry telemetry;
+                telemetry.cte = record.value[0];
+                telemetry.speed = record.value[1];
+                telemetry.angle = record.value[2];
+                replay.push_back(telemetry);
+            }
+        }
+        if(replay.empty()) {
+            cerr << "No telemetry in " << logFile << endl;
+            return -1;
+        }
+    }
+
+    // Oval track unless a centerline file is given
+    Track track = Track::Oval(300., 80., 1.);
+    if(!trackFile.empty() && !track.Load(trackFile)) {
+        cerr << "Failed to load track " << trackFile << endl;
+        return -1;
+    }
+
+    // Replays start spread out over the log so connections do not send identical frames
+    vector<Connection *> connections;
+    for(int i=0; i<numConnections; i++) {
+        Connection *connection = new Connection(i, track);
+        if(!replay.empty())
+            connection->next = replay.size()*i/numConnections;
+        connections.push_back(connection);
+    }
+
+    LoadStats stats;
+    stats.connections = numConnections;
+    stats.measureFrom = LatencyStats::Now() + uint64_t(warmup*1.e9);
+    stats.measureTo = stats.measureFrom + uint64_t(seconds*1.e9);
+
+    // Send the next frame of a connection
+    auto sendFrame = [&replay, imageBytes](uWS::WebSocket<uWS::CLIENT> ws, Connection *connection) {
+        Telemetry telemetry;
+        if(replay.empty()) {
+            telemetry = connection->car.Sense();
+        } else {
+            telemetry = replay[connection->next];
+            connection->next = (connection->next + 1) % replay.size();
+        }
+        string event = TelemetryEvent(telemetry, imageBytes);
+        connection->sentAt = LatencyStats::Now();
+        ws.send(event.data(), event.length(), uWS::OpCode::TEXT);
+    };
+
+    // Start each connection like the simulator does, just off the centerline and stopped
+    h.onConnection([&sendFrame, &stats](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest req) {
+        Connection *connection = (Connection *)ws.getUserData();
+        connection->car.Reset(0.7598, 0.);
+        stats.open++;
+        sendFrame(ws, connection);
+    });
+
+    // Each reply is answered with the next frame
+    h.onMessage([&sendFrame, &stats, &replay, numConnections](uWS::WebSocket<uWS::CLIENT> ws, char *data, size_t length, uWS::OpCode opCode) {
+        Connection *connection = (Connection *)ws.getUserData();
+        if (length > 9 && memcmp(data, "42[\"steer\"", 10) == 0) {
+            uint64_t now = LatencyStats::Now();
+            if (now >= stats.measureFrom)
+                stats.rtt.Record(now - connection->sentAt);
+            connection->frames++;
+            double steerValue, throttleValue;
+            if (replay.empty() && ParseSteer(data, length, steerValue, throttleValue))
+                connection->car.Step(steerValue, throttleValue);
+            sendFrame(ws, connection);
+        } else if (length > 9 && memcmp(data, "42[\"reset\"", 10) == 0) {
+            // The server ended the episode. Its steer reply to the last
+            // frame has already sent the next one, so only respawn here
+            // and keep a single frame in flight.
+            stats.resets++;
+            connection->car.Reset(0.7598, 0.);
+            if (!replay.empty())
+                connection->next = replay.size()*connection->id/numConnections;
+        } else if (length > 10 && memcmp(data, "42[\"manual\"", 11) == 0) {
+            sendFrame(ws, connection);
+        }
+    });
+
+    // A server that closes the connection at the end of an episode gets a new one
+    h.onDisconnection([&h, &url, &stats](uWS::WebSocket<uWS::CLIENT> ws, int code, char *message, size_t length) {
+        Connection *connection = (Connection *)ws.getUserData();
+        stats.open--;
+        stats.reconnects++;
+        h.connect(url, connection);
+    });
+
+    h.onError([&stats](void *user) {
+        Connection *connection = (Connection *)user;
+        cerr << "Connection " << connection->id << " failed" << endl;
+        if (++stats.failed == stats.connections) {
+            stats.Report();
+            exit(-1);
+        }
+    });
+
+    // Progress and end of run
+    uS::Timer *timer = new uS::Timer(h.getLoop());
+    timer->setData(&stats);
+    timer->start(Tick, 1000, 1000);
+
+    for(Connection *connection : connections)
+        h.connect(url, connection);
+    h.run();
+}
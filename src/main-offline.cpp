@@ -0,0 +1,243 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <stdlib.h>
+#include "BayesOpt.h"
+#include "CMAES.h"
+#include "CoordinateSearch.h"
+#include "EvaluationCache.h"
+#include "Evaluator.h"
+#include "Hyperband.h"
+#include "NelderMead.h"
+#include "Plant.h"
+#include "ThreadPool.h"
+#include "Twiddle.h"
+
+using namespace std;
+
+// Tune the steering gains with Twiddle against the offline plant.
+// Usage: pid-offline [--batch] [--nelder-mead | --coordinate | --hyperband | --cmaes | --bayes n] [--threads n] [--cache file] [--prune] [track centerline file]
+//   --batch       evaluate all Twiddle probes, or all Nelder-Mead candidates, of a cycle concurrently
+//   --nelder-mead Nelder-Mead simplex search instead of Twiddle
+//   --coordinate  golden section search of every gain concurrently instead of Twiddle
+//   --hyperband   successive halving of random gain sets from short laps up to a full lap
+//   --cmaes       CMA-ES over the steering and throttle gains together
+//   --bayes n     Bayesian optimization with a Gaussian process surrogate for n laps
+//   --threads n   number of evaluation threads (default: one per core)
+//   --cache file  reuse and append to the scores kept in file
+//   --prune       stop a probe once a tenth of the lap is driven if its projected error cannot beat
+//                 the best. The projection is a heuristic, so a stopped probe may have won.
+//   --no-prune    drive every probe to the end (default)
+int main(int argc, char *argv[])
+{
+    bool batch = false;
+    bool coordinate = false;
+    bool hyperband = false;
+    bool cmaes = false;
+    bool simplex = false;
+    int bayes = 0;
+    bool prune = false;
+    int numThreads = 0;
+    string trackFile;
+    string cacheFile;
+    for(int i=1; i<argc; i++) {
+        string arg = argv[i];
+        if(arg == "--batch")
+            batch = true;
+        else if(arg == "--coordinate")
+            coordinate = true;
+        else if(arg == "--hyperband")
+            hyperband = true;
+        else if(arg == "--nelder-mead")
+            simplex = true;
+        else if(arg == "--bayes" && i+1 < argc)
+            bayes = atoi(argv[++i]);
+        else if(arg == "--cmaes")
+            cmaes = true;
+        else if(arg == "--threads" && i+1 < argc)
+            numThreads = atoi(argv[++i]);
+        else if(arg == "--prune")
+            prune = true;
+        else if(arg == "--no-prune")
+            prune = false;
+        else if(arg == "--cache" && i+1 < argc)
+            cacheFile = argv[++i];
+        else
+            trackFile = arg;
+    }
+    
+    // Oval track unless a centerline file is given
+    Track track = Track::Oval(300., 80., 1.);
+    if(!trackFile.empty() && !track.Load(trackFile)) {
+        cerr << "Failed to load track " << trackFile << endl;
+        return -1;
+    }
+    printf("Track length %8.1f m with %d segments\n", track.length, track.Size());
+    
+    // Evaluator for the steering gains, or both controllers for CMA-ES
+    PlantEvaluator evaluator(track, cmaes ? SteerAndThrottleGains : SteerGains);
+    if(prune)
+        evaluator.pruneFraction = 0.1;
+    
+    // Optionally answer repeated probes from a cache file
+    char scenario[256];
+    snprintf(scenario, sizeof(scenario), "offline %s %s %gmi dt %g", trackFile.empty() ? "oval" : trackFile.c_str(),
+             cmaes ? "steer+throttle" : "steer",
+             evaluator.maxDistance, evaluator.plant.dt);
+    EvaluationCache cache(scenario);
+    CachedEvaluator cachedEvaluator(evaluator, cache);
+    GainEvaluator *scorer = &evaluator;
+    if(!cacheFile.empty()) {
+        int loaded = cache.Open(cacheFile);
+        if(loaded < 0) {
+            cerr << "Failed to open cache " << cacheFile << endl;
+            return -1;
+        }
+        printf("Loaded %d cached scores for %s\n", loaded, scenario);
+        scorer = &cachedEvaluator;
+    }
+    
+    // Initial PID gains {Kp, Ki, Kd}
+    double steerGains[3] = {0.2113, 0.0026, 21.5840};
+    double throttleGains[3] = {0.1000, 0.0001, -0.0274};
+    
+    // Initial search steps
+    double steerSearch[3] = {0.02, 0.002, 1.};
+    double throttleSearch[3] = {0.02, 0.0001, 0.01};
+    
+    // Initialize Twiddle optimizer
+    int p_num = 3;
+    double tol = .001;
+    Twiddle tw;
+    tw.Init(steerGains, steerSearch, p_num, tol);
+    
+    auto start = chrono::steady_clock::now();
+    if(cmaes) {
+        // Steer gains followed by throttle gains
+        double gains[6], scale[6];
+        for(int j=0; j<3; j++) {
+            gains[j] = steerGains[j];
+            gains[j+3] = throttleGains[j];
+            scale[j] = steerSearch[j];
+            scale[j+3] = throttleSearch[j];
+        }
+        CMAES es;
+        es.Init(gains, scale, 6, tol);
+        ThreadPool pool(numThreads);
+        printf("CMA-ES on %d threads\n", pool.Size());
+        es.Run(*scorer, pool);
+        for(int j=0; j<3; j++) {
+            steerGains[j] = gains[j];
+            throttleGains[j] = gains[j+3];
+        }
+        tw.best_error = es.best_error;
+        printf("%d generations and %d restarts\n", es.generations, es.restarts);
+    } else if(bayes > 0) {
+        // Same search box as Hyperband
+        double lower[3] = {0.02, 0.0001, 1.};
+        double upper[3] = {2., 0.1, 50.};
+        BayesOpt bo;
+        bo.Init(steerGains, lower, upper, p_num, bayes);
+        do {
+            bo.error = scorer->Evaluate(bo.p);
+            printf("For gains: ");
+            for(int j=0; j<bo.p_num; j++)
+                printf("p[%d]=%9.4f ",j,bo.p[j]);
+            printf("Error: %10.3e best %10.3e\n",bo.error,fmin(bo.error,bo.best_error));
+        } while(!bo.Update());
+        tw.best_error = bo.best_error;
+    } else if(simplex) {
+        NelderMead nm;
+        nm.Init(steerGains, steerSearch, p_num, tol);
+        if(batch) {
+            ThreadPool pool(numThreads);
+            printf("Batched Nelder-Mead on %d threads\n", pool.Size());
+            while(!nm.UpdateBatch(*scorer, pool)) {
+                printf("Iteration %d best error: %10.3e\n", nm.count, nm.best_error);
+            }
+        } else {
+            do {
+                bool complete;
+                nm.error = scorer->Evaluate(nm.p, nm.Bound(), complete);
+                printf("For gains: ");
+                for(int j=0; j<nm.p_num; j++)
+                    printf("p[%d]=%9.4f ",j,nm.p[j]);
+                printf("Error: %10.3e\n",nm.error);
+            } while(!nm.Update());
+        }
+        tw.best_error = nm.best_error;
+        printf("%d simplex iterations\n", nm.count);
+    } else if(hyperband) {
+        // Search box of each gain, laps from 1/9 mile up to maxDistance
+        double lower[3] = {0.02, 0.0001, 1.};
+        double upper[3] = {2., 0.1, 50.};
+        Hyperband hb;
+        hb.Init(lower, upper, p_num, evaluator.maxDistance/9., evaluator.maxDistance);
+        ThreadPool pool(numThreads);
+        printf("Hyperband on %d threads\n", pool.Size());
+        hb.Run(*scorer, pool);
+        for(int j=0; j<p_num; j++)
+            steerGains[j] = hb.best[j];
+        tw.best_error = hb.best_error;
+        printf("Drove %.1f miles in %ld evaluations\n", hb.distanceDriven, hb.evaluations);
+    } else if(coordinate) {
+        // Same search box as Hyperband
+        double lower[3] = {0.02, 0.0001, 1.};
+        double upper[3] = {2., 0.1, 50.};
+        CoordinateSearch cs;
+        cs.Init(steerGains, lower, upper, p_num, tol);
+        ThreadPool pool(numThreads);
+        printf("Coordinate search on %d threads\n", pool.Size());
+        bool done;
+        do {
+            done = cs.Pass(*scorer, pool);
+            printf("Pass %d gains: ", cs.passes);
+            for(int j=0; j<p_num; j++)
+                printf("p[%d]=%9.4f ",j,cs.p[j]);
+            printf("Error: %10.3e change %9.4f\n",cs.best_error,cs.change);
+        } while(!done);
+        for(int j=0; j<p_num; j++) {
+            if(cs.AtBound(j))
+                printf("p[%d]=%9.4f is at the edge of its search interval [%g, %g]\n", j, cs.p[j], lower[j], upper[j]);
+        }
+        tw.best_error = cs.best_error;
+    } else if(batch) {
+        ThreadPool pool(numThreads);
+        printf("Batched Twiddle on %d threads\n", pool.Size());
+        do {
+            printf("For gains: ");
+            for(int j=0; j<tw.p_num; j++)
+                printf("p[%d]=%9.4f ",j,tw.p[j]);
+            printf("Error: %10.3e\n",tw.best_error);
+        } while(!tw.UpdateBatch(*scorer, pool));
+    } else {
+        do {
+            bool complete;
+            tw.error = scorer->Evaluate(tw.p, tw.Incumbent(), complete);
+            printf("For gains: ");
+            for(int j=0; j<tw.p_num; j++)
+                printf("p[%d]=%9.4f ",j,tw.p[j]);
+            printf("Error: %10.3e\n",tw.error);
+        } while(!tw.Update());
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long evaluations = evaluator.evaluations;
+    
+    printf("*** Found solution ***\n");
+    printf("Optimal gain: ");
+    for(int j=0; j<tw.p_num; j++)
+        printf("p[%d]=%9.4f ",j,tw.p[j]);
+    if(cmaes) {
+        for(int j=0; j<3; j++)
+            printf("p[%d]=%9.4f ",j+3,throttleGains[j]);
+    }
+    printf("\n");
+    printf("Best error %10.3e after %ld evaluations in %.3f sec (%.1f us per evaluation)\n",
+           tw.best_error, evaluations, seconds, evaluations > 0 ? 1.e6*seconds/evaluations : 0.);
+    printf("Stopped %ld of %ld evaluations early, %.1f plant steps per evaluation\n",
+           evaluator.pruned.load(), evaluations, evaluations > 0 ? double(evaluator.steps)/evaluations : 0.);
+    if(!cacheFile.empty())
+        printf("Cache hits %ld misses %ld\n", cache.hits, cache.misses);
+    return 0;
+}
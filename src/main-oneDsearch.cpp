@@ -1,9 +1,19 @@
 #include <uWS/uWS.h>
+#include <atomic>
 #include <vector>
 #include <iostream>
 #include <math.h>
+#include <signal.h>
+#include <stdlib.h>
 #include "json.hpp"
+#include "ControlMessage.h"
+#include "Episode.h"
+#include "EvaluationCache.h"
+#include "Logger.h"
+#include "Metrics.h"
 #include "PID.h"
+#include "ResetTracker.h"
+#include "Telemetry.h"
 #include "Twiddle.h"
 #include "oneDsearch.h"
 
@@ -16,22 +26,6 @@ constexpr double pi() { return M_PI; }
 double deg2rad(double x) { return x * pi() / 180; }
 double rad2deg(double x) { return x * 180 / pi(); }
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-    string hasData(string s) {
-    auto found_null = s.find("null");
-    auto b1 = s.find_first_of("[");
-    auto b2 = s.find_last_of("]");
-    if (found_null != string::npos) {
-        return "";
-    }
-    else if (b1 != string::npos && b2 != string::npos) {
-        return s.substr(b1, b2 - b1 + 1);
-    }
-    return "";
-}
-
 struct Counters {
     int count = 0;
     double error = 0;
@@ -47,9 +41,66 @@ void simulatorRestart(uWS::WebSocket<uWS::SERVER> ws) {
 
 enum Optimize {steerOptimze, throttleOptimze, finishedOptimize};
 
-int main()
+// Event loop log, formatted and written on a background thread
+Logger logger;
+
+// Every lap driven, searching and final, printed at exit
+EpisodeLog episodes;
+
+// Finds the first frame of each lap after a reset
+ResetTracker resetTracker;
+
+void dumpEpisodes() {
+    episodes.Dump(stdout);
+    resetTracker.Dump(stdout);
+}
+
+// Set by SIGINT or SIGTERM, seen by the stop timer
+atomic<bool> stopping(false);
+
+// Ctrl-C or kill: let the event loop wind down so main returns, the
+// atexit handlers run and the logger drains
+void stopOnSignal(int signal) {
+    stopping = true;
+}
+
+// Every 100 ms: once stopping, close the listen socket, the connection
+// and this timer so the event loop runs out of work and returns
+static void checkStopping(uS::Timer *timer) {
+    if (!stopping)
+        return;
+    uWS::Hub *h = (uWS::Hub *)timer->getData();
+    h->getDefaultGroup<uWS::SERVER>().close();
+    timer->stop();
+    timer->close();
+}
+
+// Usage: pid-onedsearch [--cache file] [--episodes n]
+//   --cache file  skip laps for gains already scored in file and append new scores to it
+//   --episodes n  exit after n laps with the optimal gains (default 0, keep driving)
+int main(int argc, char *argv[])
 {
     uWS::Hub h;
+    
+    std::string cacheFile;
+    int maxEpisodes = 0;
+    for(int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        if(arg == "--cache" && i+1 < argc)
+            cacheFile = argv[++i];
+        else if(arg == "--episodes" && i+1 < argc)
+            maxEpisodes = atoi(argv[++i]);
+    }
+    
+    // Print the lap summaries on the way out
+    atexit(dumpEpisodes);
+    signal(SIGINT, stopOnSignal);
+    signal(SIGTERM, stopOnSignal);
+    
+    // The search runs until the gains stop changing, then the optimal
+    // gains are driven lap after lap
+    bool searching = true;
+    int finalLaps = 0;
 
     Counters counters;
     
@@ -72,39 +123,64 @@ int main()
     double steerBounds[2] = {-1., 1.};
     double throttleBounds[2] = {0, 1.};
     
-    // Initialize PID contoller
-    pidSteer.StoreBounds(steerBounds);
-    pidThrottle.StoreBounds(throttleBounds);
+    // Set point and steps before accumulating error. The search scores
+    // laps with its own counters, so the PID error is not used.
+    double setPoint = 0.;
+    int n2error = 0;
     
-    pidSteer.StoreGains(steerGains);
-    pidThrottle.StoreGains(throttleGains);
+    // Initialize PID contoller
+    pidSteer.Init(steerGains, steerBounds, &setPoint, &n2error);
+    pidThrottle.Init(throttleGains, throttleBounds, &setPoint, &n2error);
     
     // Construct One D Search
     oneDsearch od;
     double bounds[3][2] = {{.5, 2.}, {.001, .005}, {10., 30.}};
     
-    h.onMessage([&od, &pidSteer, &bounds, &counters, &num_p, &p_idx, &past_gains](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+    // Telemetry decoder and steer message encoder
+    TelemetryDecoder decoder;
+    ControlEncoder encoder;
+    
+    // Live state served at /metrics
+    Metrics metrics("onedsearch");
+    SessionMetrics *published = metrics.Open(0);
+    published->SetGains(pidSteer.gains, pidThrottle.gains);
+    metrics.tuner.active = true;
+    metrics.tuner.bestError = HUGE_VAL;
+    
+    // Scores of the steering gains driven so far
+    EvaluationCache cache("simulator onedsearch steer 2000 steps");
+    if (!cacheFile.empty()) {
+        int loaded = cache.Open(cacheFile);
+        if (loaded < 0) {
+            std::cerr << "Failed to open cache " << cacheFile << std::endl;
+            return -1;
+        }
+        std::cout << "Loaded " << loaded << " cached scores" << std::endl;
+    }
+    
+    h.onMessage([&decoder, &encoder, &metrics, published, &cache, &od, &pidSteer, &pidThrottle, &bounds, &counters, &num_p, &p_idx, &past_gains, &searching, &finalLaps, maxEpisodes](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
         // "42" at the start of the message means there's a websocket message event.
         // The 4 signifies a websocket message
         // The 2 signifies a websocket event
         if (length && length > 2 && data[0] == '4' && data[1] == '2')
         {
-            auto s = hasData(std::string(data).substr(0, length));
-            if (s != "") {
-                auto j = json::parse(s);
-                std::string event = j[0].get<std::string>();
-                if (event == "telemetry") {
-                    double cte = std::stod(j[1]["cte"].get<std::string>());
+            Telemetry telemetry;
+            FrameType frame = decoder.Decode(data, length, telemetry);
+            if (frame != ManualFrame) {
+                if (frame == TelemetryFrame) {
+                    double cte = telemetry.cte;
                     
                     // Need to gobble up data until reset has been achieved
-                    if(!pidSteer.isInitialized && cte != 0.7598) {
+                    ResetAction action = resetTracker.Frame(telemetry);
+                    if (action == ResendReset)
+                        simulatorRestart(ws);
+                    if (action == DiscardFrame || action == ResendReset) {
 //                        std::cout << "eating cte " << cte << std::endl;
                     } else {
-                        // j[1] is the data JSON object
                         
-                        double speed = std::stod(j[1]["speed"].get<std::string>());
-//                        double angle = std::stod(j[1]["steering_angle"].get<std::string>());
-                        double steerValue;
+                        double speed = telemetry.speed;
+//                        double angle = telemetry.angle;
+                        double steerValue = 0.;
 //                        double throttle = fmin(0.5, fmax(-1., (1. - 2.*fabs(cte))));
                         double throttle = 0.3;
                         
@@ -116,7 +192,7 @@ int main()
                          */
                         
                         // If new search then set pid gain to lhs value
-                        if(!od.isInitialized) {
+                        if(searching && !od.isInitialized) {
                             // initialize ond search with boundaries and tolerance
                             double a = bounds[p_idx][0];
                             double b = bounds[p_idx][1];
@@ -129,42 +205,73 @@ int main()
                             pidSteer.StoreGains(gains);
                         }
                         
+                        // End the lap right away if these gains have already been scored
+                        double cachedError = 0.;
+                        bool cachedLap = searching && !pidSteer.isInitialized && cache.Lookup(pidSteer.gains, num_p, cachedError);
+                        
                         // Get PID control values given current cte and speed (or initalize if necessary)
                         if(pidSteer.isInitialized) {
                             steerValue = pidSteer.ControlOutput(cte);
 //                            throttle = pidThrottle.ControlOutput(setSpeed - speed);
                         } else {
                             // Get gains based on which PID gains are being Twiddled
-                            printf("Gain is %10.4f ",pidSteer.gains[p_idx]);
-                            pidSteer.Init(cte);
+                            logger.Info("Gain is %10.4f ",pidSteer.gains[p_idx]);
+                            pidSteer.Start(cte);
 //                            pidThrottle.Init(cte);
+                            episodes.Begin();
                         }
+                        episodes.Frame(cte);
                         
                         // Send to simulator the new steering and throttle values
-                        json msgJson;
-                        msgJson["steering_angle"] = steerValue;
-                        msgJson["throttle"] = throttle;
-                        auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-                        ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+                        size_t msgLength = encoder.Encode(steerValue, throttle);
+                        ws.send(encoder.buffer, msgLength, uWS::OpCode::TEXT);
                         
                         // Accumulate the error and count the number of steps
                         counters.count++;
                         counters.error += cte*cte;
                         counters.distance += speed*.1/3600.;
+                        
+                        // Publish for the metrics endpoint
+                        published->frames.fetch_add(1, memory_order_relaxed);
+                        published->steerError.store(counters.error, memory_order_relaxed);
+                        published->distance.store(counters.distance, memory_order_relaxed);
 //                        printf("Distance traveled %10.3f with current speed %6.2f and steering value %6.2f \n",counters.distance,speed,steerValue);
                         
                         // Check stopping criteria
-                        if( (counters.count > 2000) || (fabs(cte) > 2.0) ) {
+                        if( cachedLap || (counters.count > 2000) || (fabs(cte) > 2.0) ) {
                             // Reset simulator
-                            json msgJson;
-                            msgJson["steering_angle"] = 0.;
-                            msgJson["throttle"] = 0.;
-                            auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-                            ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+                            msgLength = encoder.Encode(0., 0.);
+                            ws.send(encoder.buffer, msgLength, uWS::OpCode::TEXT);
                             simulatorRestart(ws);
+                            resetTracker.RequestReset();
+                            
+                            // Laps actually driven are kept as episodes
+                            if (!cachedLap) {
+                                EpisodeEnd end = (fabs(cte) > 2.0) ? EpisodeOffTrack : EpisodeCompleted;
+                                episodes.End(end, counters.distance, counters.error, 0.);
+                            }
+                            
+                            // After convergence only score the optimal gains and start over
+                            if (!searching) {
+                                logger.Info(" error %e \n",sqrt(counters.error)/counters.distance);
+                                pidSteer.isInitialized = false;
+                                counters.count = 0;
+                                counters.error = 0;
+                                counters.distance = 0;
+                                finalLaps++;
+                                if (maxEpisodes > 0 && finalLaps >= maxEpisodes)
+                                    exit(0);
+                                return;
+                            }
                             
                             // Normalize error by distance traveled
-                            counters.error = sqrt(counters.error)/counters.distance;
+                            if (cachedLap) {
+                                counters.error = cachedError;
+                                logger.Info("cached");
+                            } else {
+                                counters.error = sqrt(counters.error)/counters.distance;
+                                cache.Store(pidSteer.gains, num_p, counters.error);
+                            }
                             
                             // Get current gains
                             double *gains = pidSteer.gains;
@@ -180,7 +287,16 @@ int main()
                             pidSteer.gains[p_idx] = newGain;
                             pidSteer.StoreGains(gains);
                             
-                            printf(" error %e \n",counters.error);
+                            // Publish search progress
+                            metrics.tuner.evaluations++;
+                            metrics.tuner.lastError = counters.error;
+                            if (counters.error < metrics.tuner.bestError)
+                                metrics.tuner.bestError = counters.error;
+                            metrics.tuner.paramIndex = p_idx;
+                            metrics.tuner.stepSize = od.Width();
+                            published->SetGains(pidSteer.gains, pidThrottle.gains);
+                            
+                            logger.Info(" error %e \n",counters.error);
                             // set values and start over
                             pidSteer.isInitialized = false;
                             counters.count = 0;
@@ -188,7 +304,7 @@ int main()
                             counters.distance = 0;
                             
                             if(searchDone) {
-                                printf("Optimal gain for index %d is %10.4f\n",p_idx,pidSteer.gains[p_idx]);
+                                logger.Info("Optimal gain for index %d is %10.4f\n",p_idx,pidSteer.gains[p_idx]);
                                 od.isInitialized = false;
                                 
                                 // increment the p_idx
@@ -199,19 +315,20 @@ int main()
                                 // change of gain estimates
                                 if(p_idx == 0) {
                                     double sum = 0;
-                                    printf("Checking error ");
+                                    logger.Info("Checking error ");
                                     for(int j=0; j<num_p; j++) {
                                         double diff = past_gains[j]-pidSteer.gains[j];
-                                        printf(" %e ",diff);
+                                        logger.Info(" %e ",diff);
                                         sum += diff*diff;
                                         past_gains[j] = pidSteer.gains[j];
                                     }
-                                    printf(" and error is %e\n",sqrt(sum));
+                                    logger.Info(" and error is %e\n",sqrt(sum));
                                     if(sqrt(sum) < .001) {
-                                        printf("*** Optimal Gains Are ***\n");
+                                        logger.Info("*** Optimal Gains Are ***\n");
                                         for(int j=0; j<num_p; j++)
-                                            printf("Gain[%d]=%10.4f\n",j,pidSteer.gains[j]);
-                                        exit(0);
+                                            logger.Info("Gain[%d]=%10.4f\n",j,pidSteer.gains[j]);
+                                        searching = false;
+                                        metrics.tuner.active = false;
                                     }
                                 }
                             }
@@ -226,14 +343,18 @@ int main()
         }
     });
     
-    // We don't need this since we're not using HTTP but if it's removed the program
-    // doesn't compile :-(
-    h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
+    // Serves the Prometheus metrics page at /metrics
+    h.onHttpRequest([&metrics](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
         const std::string s = "<h1>Hello world!</h1>";
         if (req.getUrl().valueLength == 1)
         {
             res->end(s.data(), s.length());
         }
+        else if (req.getUrl().toString() == "/metrics")
+        {
+            const std::string page = metrics.Render();
+            res->end(page.data(), page.length());
+        }
         else
         {
             // i guess this should be done more gracefully?
@@ -247,7 +368,7 @@ int main()
     
     h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
         ws.close();
-        std::cout << "Disconnected" << std::endl;
+        logger.Info("Disconnected\n");
     });
     
     int port = 4567;
@@ -260,5 +381,9 @@ int main()
         std::cerr << "Failed to listen to port" << std::endl;
         return -1;
     }
+    uS::Timer *stopTimer = new uS::Timer(h.getLoop());
+    stopTimer->setData(&h);
+    stopTimer->start(checkStopping, 100, 100);
     h.run();
+    return 0;
 }
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+#include "Recorder.h"
+#include "Session.h"
+#include "Telemetry.h"
+#include "Twiddle.h"
+
+using namespace std;
+
+// Replay a recorded log through the controllers.
+// Usage: pid-replay log [steer Kp Ki Kd [throttle Kp Ki Kd]]
+// With the gains the log was recorded with, every command must be
+// reproduced exactly. With other gains the replay is open loop (the
+// recorded cte does not react to the new commands), so the command
+// differences show how far the new gains depart from the recorded
+// driving. Episode records end the episode in place, as the server did,
+// so a log of many episodes on one connection replays the same way.
+int main(int argc, char *argv[])
+{
+    if(argc < 2) {
+        cerr << "Usage: pid-replay log [steer Kp Ki Kd [throttle Kp Ki Kd]]" << endl;
+        return -1;
+    }
+    
+    LogReader log;
+    if(!log.Open(argv[1])) {
+        cerr << "Failed to open log " << argv[1] << endl;
+        return -1;
+    }
+    
+    // Initial PID gains {Kp, Ki, Kd}
+    double steerGains[3] = {0.2113, 0.0026, 21.5840};
+    double throttleGains[3] = {0.1000, 0.0001, -0.0274};
+    for(int j=0; j<3 && j+2<argc; j++)
+        steerGains[j] = atof(argv[j+2]);
+    for(int j=0; j<3 && j+5<argc; j++)
+        throttleGains[j] = atof(argv[j+5]);
+    
+    Session session(0, steerGains, throttleGains);
+    session.maxDistance = HUGE_VAL;
+    
+    // Replay telemetry and compare with the command recorded after it
+    size_t frames = 0;
+    size_t commands = 0;
+    double maxDiff = 0.;
+    double sumDiff2 = 0.;
+    double steerValue = 0.;
+    double throttleValue = 0.;
+    auto start = chrono::steady_clock::now();
+    for(size_t i=0; i<log.count; i++) {
+        const LogRecord &record = log.records[i];
+        if(record.kind == TelemetryRecord) {
+            Telemetry telemetry;
+            telemetry.cte = record.value[0];
+            telemetry.speed = record.value[1];
+            telemetry.angle = record.value[2];
+            session.Control(telemetry, steerValue, throttleValue);
+            frames++;
+        } else if(record.kind == EpisodeRecord) {
+            const EpisodeSummary &episode = session.EndEpisode(EpisodeEnd(int(record.value[2])));
+            printf("Episode %d: distance %8.3f, steering error %e, speed error %e\n", episode.index, episode.distance,
+                   episode.steerError, episode.throttleError);
+        } else if(record.kind == CommandRecord && frames > 0) {
+            double steerDiff = record.value[0] - steerValue;
+            double throttleDiff = record.value[1] - throttleValue;
+            maxDiff = fmax(maxDiff, fmax(fabs(steerDiff), fabs(throttleDiff)));
+            sumDiff2 += steerDiff*steerDiff + throttleDiff*throttleDiff;
+            commands++;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    printf("Replayed %zu frames in %.3f sec (%.1f ns per frame)\n", frames, seconds, 1.e9*seconds/fmax(1., frames));
+    printf("Distance traveled %8.3f in the last episode\n", session.distance);
+    printf("Steering error %e\n", Twiddle::NormalizeError(session.pidSteer.GetError(), session.pidSteer.nSteps, session.pidSteer.nCalls));
+    printf("Speed error %e\n", Twiddle::NormalizeError(session.pidThrottle.GetError(), session.pidThrottle.nSteps, session.pidThrottle.nCalls));
+    printf("Compared %zu commands, largest difference %e, rms difference %e\n", commands, maxDiff,
+           sqrt(sumDiff2/fmax(1., 2.*commands)));
+    return 0;
+}
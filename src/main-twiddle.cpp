@@ -1,8 +1,19 @@
 #include <uWS/uWS.h>
+#include <atomic>
 #include <iostream>
 #include <math.h>
+#include <signal.h>
+#include <stdlib.h>
 #include "json.hpp"
+#include "BayesOpt.h"
+#include "ControlMessage.h"
+#include "Episode.h"
+#include "EvaluationCache.h"
+#include "Logger.h"
+#include "Metrics.h"
 #include "PID.h"
+#include "ResetTracker.h"
+#include "Telemetry.h"
 #include "Twiddle.h"
 
 // for convenience
@@ -14,22 +25,6 @@ constexpr double pi() { return M_PI; }
 double deg2rad(double x) { return x * pi() / 180; }
 double rad2deg(double x) { return x * 180 / pi(); }
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(string s) {
-    auto found_null = s.find("null");
-    auto b1 = s.find_first_of("[");
-    auto b2 = s.find_last_of("]");
-    if (found_null != string::npos) {
-        return "";
-    }
-    else if (b1 != string::npos && b2 != string::npos) {
-        return s.substr(b1, b2 - b1 + 1);
-    }
-    return "";
-}
-
 
 
 // Set reset message to the simulator
@@ -41,12 +36,101 @@ void simulatorRestart(uWS::WebSocket<uWS::SERVER> ws) {
 
 enum Optimize {steerOptimze, throttleOptimze, finishedOptimize};
 
-int main()
+// Event loop log, formatted and written on a background thread
+Logger logger;
+
+// Every lap driven, tuning and final, printed at exit
+EpisodeLog episodes;
+
+// Finds the first frame of each lap after a reset
+ResetTracker resetTracker;
+
+void dumpEpisodes() {
+    episodes.Dump(stdout);
+    resetTracker.Dump(stdout);
+}
+
+// Set by SIGINT or SIGTERM, seen by the stop timer
+atomic<bool> stopping(false);
+
+// Ctrl-C or kill: let the event loop wind down so main returns, the
+// atexit handlers run and the logger drains
+void stopOnSignal(int signal) {
+    stopping = true;
+}
+
+// Every 100 ms: once stopping, close the listen socket, the connection
+// and this timer so the event loop runs out of work and returns
+static void checkStopping(uS::Timer *timer) {
+    if (!stopping)
+        return;
+    uWS::Hub *h = (uWS::Hub *)timer->getData();
+    h->getDefaultGroup<uWS::SERVER>().close();
+    timer->stop();
+    timer->close();
+}
+
+// Usage: pid-twiddle [--tune steer|throttle] [--cache file] [--bayes n] [--prune] [--episodes n]
+//   --tune which  tune the steering or throttle gains, then drive the final gains
+//                 (default: drive the initial gains without tuning)
+//   --cache file  skip laps for gains already scored in file and append new scores to it (needs --tune)
+//   --bayes n     tune with Bayesian optimization for n laps instead of Twiddle (needs --tune)
+//   --prune       stop a tuning lap once a tenth is driven if its projected error cannot beat the
+//                 best. The projection is a heuristic, so a stopped lap may have won.
+//   --no-prune    drive every tuning lap to the end (default)
+//   --episodes n  exit after n laps with the final gains (default 0, keep driving)
+int main(int argc, char *argv[])
 {
     uWS::Hub h;
     
+    string cacheFile;
+    int bayesLaps = 0;
+    int maxEpisodes = 0;
+    bool prune = false;
+    
     // test if using Twiddle optimization
     Optimize optimize = finishedOptimize;
+    
+    for(int i=1; i<argc; i++) {
+        string arg = argv[i];
+        if(arg == "--tune" && i+1 < argc) {
+            string which = argv[++i];
+            if(which == "steer")
+                optimize = steerOptimze;
+            else if(which == "throttle")
+                optimize = throttleOptimze;
+            else {
+                cerr << "--tune takes steer or throttle, not " << which << endl;
+                return -1;
+            }
+        }
+        else if(arg == "--cache" && i+1 < argc)
+            cacheFile = argv[++i];
+        else if(arg == "--bayes" && i+1 < argc)
+            bayesLaps = atoi(argv[++i]);
+        else if(arg == "--episodes" && i+1 < argc)
+            maxEpisodes = atoi(argv[++i]);
+        else if(arg == "--prune")
+            prune = true;
+        else if(arg == "--no-prune")
+            prune = false;
+    }
+    if(bayesLaps > 0 && optimize == finishedOptimize) {
+        cerr << "--bayes needs --tune steer or --tune throttle" << endl;
+        return -1;
+    }
+    if(!cacheFile.empty() && optimize == finishedOptimize) {
+        cerr << "--cache needs --tune steer or --tune throttle" << endl;
+        return -1;
+    }
+    
+    // Print the lap summaries on the way out
+    atexit(dumpEpisodes);
+    signal(SIGINT, stopOnSignal);
+    signal(SIGTERM, stopOnSignal);
+    
+    // Laps driven with the final gains
+    int finalLaps = 0;
 
     // Construct steering PID controller
     PID pidSteer;
@@ -70,9 +154,15 @@ int main()
     pidSteer.StoreGains(steerGains);
     pidThrottle.StoreGains(throttleGains);
     
+    // Set point of both controllers (the throttle input is speed-setSpeed)
+    // and steps before accumulating error
+    double setPoint = 0.;
+    int steerStart = 500;
+    int throttleStart = 100;
+    
     // Initialize the PID controllers with inputs
-    pidSteer.Init(steerGains, steerBounds, 500);
-    pidThrottle.Init(throttleGains, throttleBounds, 100);
+    pidSteer.Init(steerGains, steerBounds, &setPoint, &steerStart);
+    pidThrottle.Init(throttleGains, throttleBounds, &setPoint, &throttleStart);
 
     // Construct Twiddle optimizer
     Twiddle tw;
@@ -81,6 +171,13 @@ int main()
     double steerSearch[3] = {0.02, 0.002, 1.};
     double throttleSearch[3] = {.2, .01, 1.};
     
+    // Search boxes for Bayesian optimization
+    double steerLower[3] = {0.02, 0.0001, 1.};
+    double steerUpper[3] = {2., 0.1, 50.};
+    double throttleLower[3] = {0.01, 0., -1.};
+    double throttleUpper[3] = {1., 0.1, 1.};
+    BayesOpt bo;
+    
     // Desired speed
     double setSpeed = 35.;
     
@@ -94,9 +191,13 @@ int main()
     switch (optimize) {
         case steerOptimze:
             tw.Init(steerGains, steerSearch, p_num, tol);
+            if (bayesLaps > 0)
+                bo.Init(steerGains, steerLower, steerUpper, p_num, bayesLaps);
             break;
         case throttleOptimze:
             tw.Init(throttleGains, throttleSearch, p_num, tol);
+            if (bayesLaps > 0)
+                bo.Init(throttleGains, throttleLower, throttleUpper, p_num, bayesLaps);
             break;
         case finishedOptimize:
             tw.maxDistance=10.;
@@ -104,28 +205,84 @@ int main()
             break;
     }
 
-    h.onMessage([&tw, &pidSteer, &pidThrottle, &optimize, &maxDistance, &setSpeed](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+    // Telemetry decoder and steer message encoder
+    TelemetryDecoder decoder;
+    ControlEncoder encoder;
+    
+    // Live state served at /metrics
+    Metrics metrics("twiddle");
+    SessionMetrics *published = metrics.Open(0);
+    published->SetGains(pidSteer.gains, pidThrottle.gains);
+    metrics.tuner.active = (optimize != finishedOptimize);
+    metrics.tunerName = (bayesLaps > 0) ? "bayes" : "twiddle";
+    
+    // Scores of the gains driven so far, keyed on which gains are tuned and the lap length
+    char scenario[64];
+    snprintf(scenario, sizeof(scenario), "simulator twiddle %s %gmi", optimize == throttleOptimze ? "throttle" : "steer", maxDistance);
+    EvaluationCache cache(scenario);
+    if (!cacheFile.empty()) {
+        int loaded = cache.Open(cacheFile);
+        if (loaded < 0) {
+            cerr << "Failed to open cache " << cacheFile << endl;
+            return -1;
+        }
+        cout << "Loaded " << loaded << " cached scores" << endl;
+    }
+    
+    // Both tuners write the next gains into the array tw.p points at.
+    // Laps stopped early give Bayesian optimization an error that is
+    // still above the best, which is all the model needs to know.
+    auto updateTuner = [&tw, &bo, bayesLaps]() {
+        if (bayesLaps == 0)
+            return tw.Update();
+        bo.error = tw.error;
+        bool done = bo.Update();
+        tw.best_error = bo.best_error;
+        return done;
+    };
+    auto incumbent = [&tw, &bo, bayesLaps]() {
+        return (bayesLaps > 0) ? bo.Incumbent() : tw.Incumbent();
+    };
+    
+    // Push the error of the lap just driven and move the tuner on,
+    // skipping any gains that have already been scored. Laps stopped
+    // early are not cached.
+    auto updateTwiddle = [&tw, &cache, &updateTuner](bool complete) {
+        if (complete)
+            cache.Store(tw.p, tw.p_num, tw.error);
+        bool converged = updateTuner();
+        double cached;
+        while(!converged && cache.Lookup(tw.p, tw.p_num, cached)) {
+            logger.Info("Cached error: %10.3e\n", cached);
+            tw.error = cached;
+            converged = updateTuner();
+        }
+        return converged;
+    };
+    
+    h.onMessage([&decoder, &encoder, &metrics, published, &updateTwiddle, &incumbent, &tw, &pidSteer, &pidThrottle, &optimize, &maxDistance, &setSpeed, &finalLaps, maxEpisodes, prune](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
         // "42" at the start of the message means there's a websocket message event.
         // The 4 signifies a websocket message
         // The 2 signifies a websocket event
         if (length && length > 2 && data[0] == '4' && data[1] == '2')
         {
-            auto s = hasData(string(data).substr(0, length));
-            if (s != "") {
-                auto j = json::parse(s);
-                string event = j[0].get<string>();
-                if (event == "telemetry") {
-                    double cte = stod(j[1]["cte"].get<string>());
+            Telemetry telemetry;
+            FrameType frame = decoder.Decode(data, length, telemetry);
+            if (frame != ManualFrame) {
+                if (frame == TelemetryFrame) {
+                    double cte = telemetry.cte;
                     
                     // Need to gobble up data until reset has been achieved
-                    if(!pidSteer.isInitialized && cte != 0.7598) {
+                    ResetAction action = resetTracker.Frame(telemetry);
+                    if (action == ResendReset)
+                        simulatorRestart(ws);
+                    if (action == DiscardFrame || action == ResendReset) {
 //                        cout << "eating cte " << cte << endl;
                     } else {
-                        // j[1] is the data JSON object
 //                        const double Angle2Steer = -deg2rad(25.);
-                        double speed = stod(j[1]["speed"].get<string>());
-//                        double angle = stod(j[1]["steering_angle"].get<string>());
-                        double throttleValue;
+                        double speed = telemetry.speed;
+//                        double angle = telemetry.angle;
+                        double throttleValue = 1.;
                         double steerValue = 0.;
                         double *steerGains = nullptr;
                         double *throttleGains = nullptr;
@@ -155,96 +312,134 @@ int main()
                                 case throttleOptimze:
                                     steerGains = pidSteer.gains;
                                     throttleGains = tw.p;
+                                    break;
                                     
                                 case finishedOptimize:
+                                default:
                                     steerGains = pidSteer.gains;
                                     throttleGains = pidThrottle.gains;
-                                    
-                                default:
                                     break;
                             }
+                            
+                            // PID copies the gains, so reload the ones being tuned
+                            pidSteer.StoreGains(steerGains);
+                            pidThrottle.StoreGains(throttleGains);
                             pidSteer.Start(cte);
                             pidThrottle.Start(speed-setSpeed);
+                            episodes.Begin();
                         }
+                        episodes.Frame(cte);
                         
                         // Send to simulator the new steering and throttle values
-                        json msgJson;
-                        msgJson["steering_angle"] = steerValue;
-                        msgJson["throttle"] = throttleValue;
-                        auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-                        ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+                        size_t msgLength = encoder.Encode(steerValue, throttleValue);
+                        ws.send(encoder.buffer, msgLength, uWS::OpCode::TEXT);
 
                         // Accumulate the error and count the number of steps
                         double distanceIncrement = speed*0.1/3600.;
                         tw.distance += distanceIncrement; // assuming 0.1 sec per simulator increment
                         
+                        // Publish for the metrics endpoint
+                        published->frames.fetch_add(1, memory_order_relaxed);
+                        published->steerError.store(pidSteer.GetError(), memory_order_relaxed);
+                        published->throttleError.store(pidThrottle.GetError(), memory_order_relaxed);
+                        published->distance.store(tw.distance, memory_order_relaxed);
+                        
                         if(optimize == finishedOptimize)
-                            printf("CTE: %5.2f, Steering Value: %6.3f, Throttle: %6.3f, Distance Traveled: %6.2f\n",cte,steerValue, throttleValue, tw.distance);
+                            logger.Debug("CTE: %5.2f, Steering Value: %6.3f, Throttle: %6.3f, Distance Traveled: %6.2f\n",cte,steerValue, throttleValue, tw.distance);
+                        
+                        // With --prune, stop a tuning lap once its error is not expected to
+                        // beat the best so far, guessing the rest of the lap at twice the
+                        // steps per mile so far. A heuristic: a stopped lap might have ended lower.
+                        bool hopeless = false;
+                        if (prune && optimize != finishedOptimize && tw.distance > 0.1*maxDistance && tw.distance <= maxDistance) {
+                            PID &tuned = (optimize == steerOptimze) ? pidSteer : pidThrottle;
+                            double projected = Twiddle::ProjectedError(tuned.GetError(), tuned.nSteps, tuned.nCalls, tw.distance/maxDistance, 2.);
+                            hopeless = (projected >= incumbent());
+                            if (hopeless)
+                                logger.Info("Stopped early at %6.2f miles: ", tw.distance);
+                        }
                         
                         // Check stopping criteria
-                        if( (tw.distance > maxDistance) || (fabs(cte) > cteMax) ) {
+                        if( hopeless || (tw.distance > maxDistance) || (fabs(cte) > cteMax) ) {
+                            bool tuning = (optimize != finishedOptimize);
+                            EpisodeEnd end = hopeless ? EpisodeStopped : (fabs(cte) > cteMax ? EpisodeOffTrack : EpisodeCompleted);
+                            const EpisodeSummary &episode = episodes.End(end, tw.distance, pidSteer.GetError(), pidThrottle.GetError());
                             
                             switch (optimize) {
                                 case steerOptimze:
-                                    tw.SetError(pidSteer.error, pidSteer.nSteps, pidSteer.nCalls);
-                                    printf("For gains: ");
+                                    tw.SetError(pidSteer.GetError(), pidSteer.nSteps, pidSteer.nCalls);
+                                    logger.Info("For gains: ");
                                     for(int j=0; j<tw.p_num; j++)
-                                        printf("p[%d]=%9.4f ",j,tw.p[j]);
-                                    printf("Error: %10.3e\n",tw.error);
+                                        logger.Info("p[%d]=%9.4f ",j,tw.p[j]);
+                                    logger.Info("Error: %10.3e\n",tw.error);
                                     // Get new gain estimate
-                                    if( tw.Update() ) {
-                                        printf("*** Found solution ***\n");
-                                        printf("Optimal gain: ");
+                                    if( updateTwiddle(!hopeless) ) {
+                                        logger.Info("*** Found solution ***\n");
+                                        logger.Info("Optimal gain: ");
                                         for(int j=0; j<tw.p_num; j++)
-                                            printf("p[%d]=%9.4f ",j,tw.p[j]);
-                                        printf("\n");
+                                            logger.Info("p[%d]=%9.4f ",j,tw.p[j]);
+                                        logger.Info("\n");
                                         optimize = finishedOptimize;   // now do a couple of laps with the final solution
                                         tw.maxDistance = 10.;
+                                        maxDistance = 10.;
                                     }
                                     break;
                                     
                                 case throttleOptimze:
-                                    tw.SetError(pidThrottle.error, pidThrottle.nSteps, pidThrottle.nCalls);
-                                    printf("For gains: ");
+                                    tw.SetError(pidThrottle.GetError(), pidThrottle.nSteps, pidThrottle.nCalls);
+                                    logger.Info("For gains: ");
                                     for(int j=0; j<tw.p_num; j++)
-                                        printf("p[%d]=%9.4f ",j,tw.p[j]);
-                                    printf("Error: %10.3e\n",tw.error);
+                                        logger.Info("p[%d]=%9.4f ",j,tw.p[j]);
+                                    logger.Info("Error: %10.3e\n",tw.error);
                                     // Get new gain estimate
-                                    if( tw.Update() ) {
-                                        printf("*** Found solution ***\n");
-                                        printf("Optimal gain: ");
+                                    if( updateTwiddle(!hopeless) ) {
+                                        logger.Info("*** Found solution ***\n");
+                                        logger.Info("Optimal gain: ");
                                         for(int j=0; j<tw.p_num; j++)
-                                            printf("p[%d]=%9.4f ",j,tw.p[j]);
-                                        printf("\n");
+                                            logger.Info("p[%d]=%9.4f ",j,tw.p[j]);
+                                        logger.Info("\n");
                                         optimize = finishedOptimize;   // now do a couple of laps with the final solution
                                         tw.maxDistance = 10.;
+                                        maxDistance = 10.;
                                     }
                                     break;
                                     
                                 case finishedOptimize:
-                                    tw.SetError(pidSteer.error, pidSteer.nSteps, pidSteer.nCalls);
-                                    simulatorRestart(ws);
-                                    printf("Total steering error is %f\n",tw.error);
-                                    exit(0);
+                                    // Keep driving laps with the final gains on this connection
+                                    tw.SetError(pidSteer.GetError(), pidSteer.nSteps, pidSteer.nCalls);
+                                    logger.Info("Episode %d (%s) total steering error is %f\n",episode.index,EpisodeLog::Name(episode.end),tw.error);
+                                    finalLaps++;
+                                    if (maxEpisodes > 0 && finalLaps >= maxEpisodes) {
+                                        simulatorRestart(ws);
+                                        exit(0);
+                                    }
                                     break;
                                     
                                 default:
                                     break;
                             }
                             
+                            // Publish tuner progress
+                            if (tuning) {
+                                metrics.tuner.evaluations++;
+                                metrics.tuner.lastError = tw.error;
+                                metrics.tuner.bestError = tw.best_error;
+                                metrics.tuner.paramIndex = tw.p_idx;
+                                metrics.tuner.stepSize = tw.Magnitued(tw.dp);
+                            }
+                            
                             // set values and simulator
                             pidSteer.isInitialized = false;
                             pidThrottle.isInitialized = false;
                             tw.count = 0;
                             tw.error = 0.;
                             tw.distance = 0.;
+                            published->SetGains(pidSteer.gains, pidThrottle.gains);
                             cte = 0;
-                            json msgJson;
-                            msgJson["steering_angle"] = 0.;
-                            msgJson["throttle"] = 0.;
-                            auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-                            ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+                            msgLength = encoder.Encode(0., 0.);
+                            ws.send(encoder.buffer, msgLength, uWS::OpCode::TEXT);
                             simulatorRestart(ws);
+                            resetTracker.RequestReset();
                         }
                     }
                 }
@@ -256,14 +451,18 @@ int main()
         }
     });
     
-    // We don't need this since we're not using HTTP but if it's removed the program
-    // doesn't compile :-(
-    h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
+    // Serves the Prometheus metrics page at /metrics
+    h.onHttpRequest([&metrics](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
         const string s = "<h1>Hello world!</h1>";
         if (req.getUrl().valueLength == 1)
         {
             res->end(s.data(), s.length());
         }
+        else if (req.getUrl().toString() == "/metrics")
+        {
+            const string page = metrics.Render();
+            res->end(page.data(), page.length());
+        }
         else
         {
             // i guess this should be done more gracefully?
@@ -277,7 +476,7 @@ int main()
     
     h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
         ws.close();
-        cout << "Disconnected" << endl;
+        logger.Info("Disconnected\n");
     });
     
     int port = 4567;
@@ -290,5 +489,9 @@ int main()
         cerr << "Failed to listen to port" << endl;
         return -1;
     }
+    uS::Timer *stopTimer = new uS::Timer(h.getLoop());
+    stopTimer->setData(&h);
+    stopTimer->start(checkStopping, 100, 100);
     h.run();
+    return 0;
 }
@@ -1,8 +1,21 @@
 #include <uWS/uWS.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
 #include "json.hpp"
+#include "ControlMessage.h"
+#include "Logger.h"
+#include "Histogram.h"
+#include "Metrics.h"
 #include "PID.h"
+#include "Realtime.h"
+#include "Session.h"
+#include "Telemetry.h"
 
 // for convenience
 using json = nlohmann::json;
@@ -13,24 +26,6 @@ constexpr double pi() { return M_PI; }
 double deg2rad(double x) { return x * pi() / 180; }
 double rad2deg(double x) { return x * 180 / pi(); }
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(string s) {
-    auto found_null = s.find("null");
-    auto b1 = s.find_first_of("[");
-    auto b2 = s.find_last_of("]");
-    if (found_null != string::npos) {
-        return "";
-    }
-    else if (b1 != string::npos && b2 != string::npos) {
-        return s.substr(b1, b2 - b1 + 1);
-    }
-    return "";
-}
-
-
-
 // Set reset message to the simulator
 void simulatorRestart(uWS::WebSocket<uWS::SERVER> ws) {
     // send restart message to simulator
@@ -40,91 +35,226 @@ void simulatorRestart(uWS::WebSocket<uWS::SERVER> ws) {
 
 enum Optimize {steerOptimze, throttleOptimze, finishedOptimize};
 
-int main()
-{
-    uWS::Hub h;
+// Most event loop threads
+static const int maxShards = 64;
 
-    // Construct steering PID controller
-    PID pidSteer;
-    PID pidThrottle;
+/*
+ * Settings shared read only by every event loop
+ */
+struct ServerOptions {
+    // port all event loops listen on
+    int port;
     
+    // number of event loops
+    int numShards;
     
-    // Initial PID gains {Kp, Ki, Kd}
-    double steerGains[3] = {0.2113, 0.0026, 21.5840};
-    double throttleGains[3] = {0.1000, 0.0001, -0.0274};
+    // pin each event loop thread to a core, starting at firstCore
+    bool pin;
+    int firstCore;
+    
+    // lock memory, warm the telemetry path and watch for page faults
+    // and allocations after startup
+    bool realtime;
+    
+    // SCHED_FIFO priority of the event loop threads, 0 to leave them alone
+    int fifoPriority;
+    
+    // session telemetry logs, empty for none
+    string recordPrefix;
     
-    // PID bounds
-    double steerBounds[2] = {-1., 1.};
-    double throttleBounds[2] = {-1., 1.};
+    // episodes per connection before it is closed, 0 for no limit
+    int maxEpisodes;
     
-    // Initialize PID contoller
-    pidSteer.StoreBounds(steerBounds);
-    pidThrottle.StoreBounds(throttleBounds);
+    // latency dump interval (ms), 0 for none
+    int dumpInterval;
     
-    pidSteer.StoreGains(steerGains);
-    pidThrottle.StoreGains(throttleGains);
+    // initial PID gains {Kp, Ki, Kd}, copied into each session
+    double steerGains[3];
+    double throttleGains[3];
+};
+
+/*
+ * One event loop thread and the state only it touches: its sessions,
+ * log ring and latency histograms
+ */
+struct Shard {
+    // shard number, also the low part of its session ids
+    int index;
+    
+    // event loop log, formatted and written on a background thread
+    Logger logger;
     
+    // message handler latency
+    LatencyStats *latency;
     
-    // Desired set points
-    double setCte = 0.;
-    double setSpeed = 35.;
+    // sessions started on this shard
+    int numSessions;
     
-    // Number of steps before accumulating error
-    int n2error = 0;
+    // page faults and allocations after startup in realtime mode
+    RealtimeMonitor monitor;
     
-    // Initialize the PID controllers with inputs
-    pidSteer.Init(steerGains, steerBounds, &setCte, &n2error);
-    pidThrottle.Init(throttleGains, throttleBounds, &setSpeed, &n2error);
+    // event loop while it runs, and its timers, closed on shutdown
+    uWS::Hub *hub;
+    vector<uS::Timer *> timers;
     
-    double distance = 0.;
-    double maxDistance = 10.;
+    Shard(int index, LatencyStats *latency): index(index), latency(latency), numSessions(0), hub(nullptr) {};
+};
+
+// Message handler latency of every shard, dumped on shutdown
+LatencyStats *latency = nullptr;
+int numLatency = 0;
+
+// Live state served at /metrics, shared by all shards
+Metrics metrics;
+
+// Every shard, for the shutdown reports
+vector<Shard *> shards;
+
+// Set by SIGINT or SIGTERM, seen by every shard's stop timer
+atomic<bool> stopping(false);
+
+void dumpLatency() {
+    if(numLatency == 1) {
+        latency[0].Dump(stdout);
+    } else if(numLatency > 1) {
+        LatencyStats all;
+        for(int i=0; i<numLatency; i++)
+            all.Add(latency[i]);
+        all.Dump(stdout);
+    }
+}
+
+// Ctrl-C or kill: let the event loops wind down so the loggers drain
+void stopOnSignal(int signal) {
+    stopping = true;
+}
+
+void dumpRealtime() {
+    for(Shard *shard : shards)
+        printf("Shard %d: %llu page faults, %llu allocations after startup\n", shard->index,
+               (unsigned long long)shard->monitor.faults.load(), (unsigned long long)shard->monitor.allocations.load());
+    fflush(stdout);
+}
+
+// Every --latency-interval: dump this shard's histograms from a timer,
+// off the message path. stdout is held so dumps of different shards do
+// not interleave.
+static void dumpShardLatency(uS::Timer *timer) {
+    Shard *shard = (Shard *)timer->getData();
+    flockfile(stdout);
+    printf("Shard %d\n", shard->index);
+    shard->latency->Dump(stdout);
+    funlockfile(stdout);
+}
+
+// Every 100 ms: once stopping, close the listen socket, the connections
+// and the timers so the event loop runs out of work and returns
+static void checkStopping(uS::Timer *timer) {
+    Shard *shard = (Shard *)timer->getData();
+    if (!stopping)
+        return;
+    shard->hub->getDefaultGroup<uWS::SERVER>().close();
+    for(uS::Timer *t : shard->timers) {
+        t->stop();
+        t->close();
+    }
+    shard->timers.clear();
+}
+
+// Once a second in realtime mode: warn when the event loop thread has
+// faulted or allocated since the last check
+static void checkRealtime(uS::Timer *timer) {
+    Shard *shard = (Shard *)timer->getData();
+    if (shard->monitor.Check())
+        shard->logger.Warning("Shard %d: %llu page faults, %llu allocations after startup\n", shard->index,
+                              (unsigned long long)shard->monitor.faults.load(), (unsigned long long)shard->monitor.allocations.load());
+}
 
-    h.onMessage([&pidSteer, &pidThrottle, &distance, &maxDistance](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+// Drive a throwaway session through the whole frame path so the code,
+// the stack and any lazily initialized library state (strtod, snprintf)
+// are faulted in before the first simulator connects
+static void warmTelemetryPath(const ServerOptions *options) {
+    PrefaultStack(256*1024);
+    Session session(-1, options->steerGains, options->throttleGains);
+    LatencyStats warm;
+    Telemetry telemetry = {0.7598, 0., 0.};
+    for(int k=0; k<1000; k++) {
+        string text = TelemetryEvent(telemetry);
+        uint64_t t0 = LatencyStats::Now();
+        session.decoder.Decode(text.data(), text.length(), telemetry);
+        double steerValue, throttleValue;
+        session.Control(telemetry, steerValue, throttleValue);
+        session.encoder.Encode(steerValue, throttleValue);
+        warm.stage[TotalStage].Record(LatencyStats::Now() - t0);
+        telemetry.cte *= 0.99;
+        telemetry.speed = min(30., telemetry.speed + 0.1);
+    }
+}
+
+// Run one event loop. Every shard listens on the same port with
+// SO_REUSEPORT so the kernel spreads new connections across them; a
+// connection then stays on the shard that accepted it.
+static bool runShard(Shard *shard, const ServerOptions *options) {
+    uWS::Hub h;
+    shard->hub = &h;
+    
+    h.onMessage([shard, options](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+        uint64_t t0 = LatencyStats::Now();
+        LatencyStats &latency = *shard->latency;
+        uint64_t allocations = ThreadAllocations();
+        
+        // Controller state of this connection
+        Session *session = (Session *)ws.getUserData();
+        if (session == nullptr)
+            return;
+        
         // "42" at the start of the message means there's a websocket message event.
         // The 4 signifies a websocket message
         // The 2 signifies a websocket event
         if (length && length > 2 && data[0] == '4' && data[1] == '2')
         {
-            auto s = hasData(string(data).substr(0, length));
-            if (s != "") {
-                auto j = json::parse(s);
-                string event = j[0].get<string>();
-                if (event == "telemetry") {
-                    double cte = stod(j[1]["cte"].get<string>());
-                    // j[1] is the data JSON object
-//                        const double Angle2Steer = -deg2rad(25.);
-                    double speed = stod(j[1]["speed"].get<string>());
-//                        double angle = stod(j[1]["steering_angle"].get<string>());
-                    double throttleValue = 1.;
-                    double steerValue = 0.;
+            Telemetry telemetry;
+            unsigned long slowFrames = session->decoder.slowFrames;
+            FrameType frame = session->decoder.Decode(data, length, telemetry);
+            uint64_t t1 = LatencyStats::Now();
+            latency.stage[session->decoder.slowFrames == slowFrames ? DecodeStage : ParseStage].Record(t1 - t0);
+            ResetAction action = (frame == TelemetryFrame) ? session->reset.Frame(telemetry) : ContinueEpisode;
+            if (action == ResendReset)
+                simulatorRestart(ws);
+            if (action == DiscardFrame || action == ResendReset) {
+                // Frame from before the respawn, answered with the car stopped
+                size_t msgLength = session->encoder.Encode(0., 0.);
+                ws.send(session->encoder.buffer, msgLength, uWS::OpCode::TEXT);
+            } else if (frame != ManualFrame) {
+                if (frame == TelemetryFrame) {
+                    double cte = telemetry.cte;
+                    double steerValue;
+                    double throttleValue;
                     
                     // Get PID control values given current cte and speed (or start controller if necessary)
-                    if(pidSteer.isInitialized) {
-                        steerValue = pidSteer.ControlOutput(cte);
-                        throttleValue = pidThrottle.ControlOutput(speed);
-                    } else {
-                        pidSteer.Start(cte);
-                        pidThrottle.Start(speed);
-                    }
+                    bool finished = session->Control(telemetry, steerValue, throttleValue);
+                    uint64_t t2 = LatencyStats::Now();
+                    latency.stage[ControlStage].Record(t2 - t1);
                     
                     // Send to simulator the new steering and throttle values
-                    json msgJson;
-                    msgJson["steering_angle"] = steerValue;
-                    msgJson["throttle"] = throttleValue;
-                    auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-                    ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-
-                    // Accumulate the error and count the number of steps
-                    double distanceIncrement = speed*0.1/3600.;
-                    distance += distanceIncrement; // assuming 0.1 sec per simulator increment
-                    printf("CTE: %5.2f, Steering Value: %6.3f, Throttle: %6.3f, Distance Traveled: %6.2f\n",cte,steerValue, throttleValue, distance);
+                    size_t msgLength = session->encoder.Encode(steerValue, throttleValue);
+                    uint64_t t3 = LatencyStats::Now();
+                    latency.stage[EncodeStage].Record(t3 - t2);
+                    ws.send(session->encoder.buffer, msgLength, uWS::OpCode::TEXT);
+                    uint64_t t4 = LatencyStats::Now();
+                    latency.stage[SendStage].Record(t4 - t3);
+                    latency.stage[TotalStage].Record(t4 - t0);
                     
-                    // Check stopping criteria
-                    if( distance > maxDistance) {
-                        printf("Total steering error is %f\n",sqrt(pidSteer.GetError())/distance);
-                        printf("Total speed error is %f\n",sqrt(pidThrottle.GetError())/distance);
+                    shard->logger.Debug("Session %d CTE: %5.2f, Steering Value: %6.3f, Throttle: %6.3f, Distance Traveled: %6.2f\n",session->id,cte,steerValue, throttleValue, session->distance);
+                    
+                    // End the episode in place and start the next one on the same connection
+                    if(finished) {
+                        const EpisodeSummary &episode = session->EndEpisode(EpisodeCompleted);
+                        shard->logger.Info("Session %d episode %d total steering error is %f\n",session->id,episode.index,episode.steerError);
+                        shard->logger.Info("Session %d episode %d total speed error is %f\n",session->id,episode.index,episode.throttleError);
                         simulatorRestart(ws);
-                        exit(0);
+                        if (options->maxEpisodes > 0 && int(session->episodes.episodes.size()) >= options->maxEpisodes)
+                            ws.close();
                     }
                 }
             } else {
@@ -133,16 +263,22 @@ int main()
                 ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
             }
         }
+        if (options->realtime)
+            shard->monitor.allocations.fetch_add(ThreadAllocations() - allocations, memory_order_relaxed);
     });
     
-    // We don't need this since we're not using HTTP but if it's removed the program
-    // doesn't compile :-(
+    // Serves the Prometheus metrics page at /metrics
     h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
         const string s = "<h1>Hello world!</h1>";
         if (req.getUrl().valueLength == 1)
         {
             res->end(s.data(), s.length());
         }
+        else if (req.getUrl().toString() == "/metrics")
+        {
+            const string page = metrics.Render();
+            res->end(page.data(), page.length());
+        }
         else
         {
             // i guess this should be done more gracefully?
@@ -150,24 +286,187 @@ int main()
         }
     });
     
-    h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
-//        cout << "Connected!!!" << endl;
+    // Each connection gets its own controllers and distance. Session ids
+    // are unique across shards.
+    h.onConnection([shard, options](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+        int id = shard->numSessions++*options->numShards + shard->index;
+        Session *session = new Session(id, options->steerGains, options->throttleGains);
+        if (req.getUrl().valueLength > 0)
+            session->ParseGains(req.getUrl().toString());
+        session->metrics = metrics.Open(session->id);
+        if (session->metrics != nullptr)
+            session->metrics->SetGains(session->steerGains, session->throttleGains);
+        if (!options->recordPrefix.empty()) {
+            session->recorder = new Recorder(options->recordPrefix + "-" + to_string(session->id) + ".pidlog");
+            if (!session->recorder->IsOpen()) {
+                shard->logger.Warning("Session %d could not open %s-%d.pidlog, not recording\n", session->id,
+                                      options->recordPrefix.c_str(), session->id);
+                delete session->recorder;
+                session->recorder = nullptr;
+            }
+        }
+        ws.setUserData(session);
+        shard->logger.Info("Session %d connected\n", session->id);
     });
     
-    h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+    h.onDisconnection([shard](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+        Session *session = (Session *)ws.getUserData();
+        if (session != nullptr) {
+            shard->logger.Info("Session %d disconnected after %d episodes\n", session->id, int(session->episodes.episodes.size()));
+            if (session->reset.latency.Count() > 0)
+                shard->logger.Info("Session %d reset latency p50 %.1f ms, max %.1f ms, %lu stale frames, %lu resets sent again\n", session->id,
+                                   session->reset.latency.Percentile(0.5)*1.e-6, session->reset.latency.Max()*1.e-6,
+                                   session->reset.discarded, session->reset.resends);
+            if (session->recorder != nullptr && session->recorder->dropped > 0)
+                shard->logger.Warning("Session %d dropped %lu records\n", session->id, session->recorder->dropped.load());
+            ws.setUserData(nullptr);
+            metrics.Close(session->metrics);
+            delete session;
+        }
         ws.close();
-        cout << "Disconnected" << endl;
     });
     
-    int port = 4567;
-    if (h.listen(port))
-    {
-        cout << "Listening to port " << port << endl;
+    int numCores = max(1, int(thread::hardware_concurrency()));
+    if (options->pin && !PinThread((options->firstCore + shard->index) % numCores))
+        shard->logger.Warning("Shard %d could not be pinned to a core\n", shard->index);
+    if (options->fifoPriority > 0 && !SetFifoPriority(options->fifoPriority))
+        shard->logger.Warning("Shard %d could not be given SCHED_FIFO priority %d\n", shard->index, options->fifoPriority);
+    if (options->dumpInterval > 0) {
+        uS::Timer *timer = new uS::Timer(h.getLoop());
+        timer->setData(shard);
+        timer->start(dumpShardLatency, options->dumpInterval, options->dumpInterval);
+        shard->timers.push_back(timer);
+    }
+    if (options->realtime) {
+        warmTelemetryPath(options);
+        uS::Timer *timer = new uS::Timer(h.getLoop());
+        timer->setData(shard);
+        timer->start(checkRealtime, 1000, 1000);
+        shard->timers.push_back(timer);
+        shard->monitor.Arm();
     }
-    else
+    uS::Timer *stopTimer = new uS::Timer(h.getLoop());
+    stopTimer->setData(shard);
+    stopTimer->start(checkStopping, 100, 100);
+    shard->timers.push_back(stopTimer);
+    int listenOptions = options->numShards > 1 ? uS::ListenOptions::REUSE_PORT : 0;
+    if (!h.listen(options->port, nullptr, listenOptions))
+        return false;
+    if (shard->index == 0)
+        cout << "Listening to port " << options->port << " on " << options->numShards << " event loops" << endl;
+    h.run();
+    shard->hub = nullptr;
+    return true;
+}
+
+// Usage: pid [--record prefix] [--latency-interval seconds] [--log-level level] [--threads n] [--no-pin]
+//            [--realtime] [--cpu n] [--fifo priority] [--episodes n]
+//   --record prefix             log each session's telemetry and commands to prefix-<session>.pidlog
+//   --latency-interval seconds  also dump the latency histograms every interval
+//   --log-level level           debug (every frame, default), info, warning, error or off
+//   --threads n                 event loop threads, each pinned to a core (default 1, 0 for one per core)
+//   --no-pin                    do not pin the event loop threads
+//   --realtime                  lock memory, pin even a single event loop, warm the telemetry path
+//                               before listening and report page faults and allocations after that
+//   --cpu n                     first core to pin to (default 0)
+//   --fifo priority             run the event loops under SCHED_FIFO at priority (1 to 99)
+//   --episodes n                close a connection after n episodes (default 0, keep driving)
+int main(int argc, char *argv[])
+{
+    ServerOptions options;
+    options.port = 4567;
+    options.numShards = 1;
+    options.pin = true;
+    options.firstCore = 0;
+    options.realtime = false;
+    options.fifoPriority = 0;
+    options.maxEpisodes = 0;
+    bool noPin = false;
+    double latencyInterval = 0.;
+    LogLevel logLevel = LogDebug;
+    for(int i=1; i<argc; i++) {
+        string arg = argv[i];
+        if(arg == "--record" && i+1 < argc)
+            options.recordPrefix = argv[++i];
+        else if(arg == "--latency-interval" && i+1 < argc)
+            latencyInterval = atof(argv[++i]);
+        else if(arg == "--log-level" && i+1 < argc)
+            logLevel = Logger::ParseLevel(argv[++i]);
+        else if(arg == "--threads" && i+1 < argc)
+            options.numShards = atoi(argv[++i]);
+        else if(arg == "--no-pin")
+            noPin = true;
+        else if(arg == "--realtime")
+            options.realtime = true;
+        else if(arg == "--cpu" && i+1 < argc)
+            options.firstCore = atoi(argv[++i]);
+        else if(arg == "--fifo" && i+1 < argc)
+            options.fifoPriority = atoi(argv[++i]);
+        else if(arg == "--episodes" && i+1 < argc)
+            options.maxEpisodes = atoi(argv[++i]);
+    }
+    if(options.numShards <= 0)
+        options.numShards = max(1, int(thread::hardware_concurrency()));
+    options.numShards = min(options.numShards, maxShards);
+    // a lone event loop keeps the old unpinned behavior unless it is realtime
+    options.pin = !noPin && (options.numShards > 1 || options.realtime);
+    options.dumpInterval = latencyInterval > 0. ? max(1, int(latencyInterval*1000.)) : 0;
+    
+    // Initial PID gains {Kp, Ki, Kd}
+    const double steerGains[3] = {0.2113, 0.0026, 21.5840};
+    const double throttleGains[3] = {0.1000, 0.0001, -0.0274};
+    copy(steerGains, steerGains + 3, options.steerGains);
+    copy(throttleGains, throttleGains + 3, options.throttleGains);
+    
+    // Dump latency histograms on shutdown
+    latency = new LatencyStats[options.numShards];
+    numLatency = options.numShards;
+    metrics.latency = latency;
+    metrics.numLatency = numLatency;
+    signal(SIGINT, stopOnSignal);
+    signal(SIGTERM, stopOnSignal);
+    
+    // Shard 0 runs on the main thread, the others on their own threads
+    for(int i=0; i<options.numShards; i++) {
+        shards.push_back(new Shard(i, &latency[i]));
+        shards[i]->logger.level = logLevel;
+    }
+    
+    // Everything allocated so far stays resident, and so does anything
+    // allocated later
+    if(options.realtime) {
+        if(!LockMemory())
+            cerr << "Could not lock memory, check ulimit -l" << endl;
+    }
+    vector<thread> threads;
+    for(int i=1; i<options.numShards; i++) {
+        threads.push_back(thread([&options, i]() {
+            if (!runShard(shards[i], &options)) {
+                cerr << "Shard " << i << " failed to listen to port" << endl;
+                exit(-1);
+            }
+        }));
+    }
+    
+    if (!runShard(shards[0], &options))
     {
         cerr << "Failed to listen to port" << endl;
         return -1;
     }
-    h.run();
+    for(thread &t : threads)
+        t.join();
+    
+    // Every event loop has returned: report, then let the loggers drain
+    dumpLatency();
+    if(options.realtime)
+        dumpRealtime();
+    for(Shard *shard : shards)
+        delete shard;
+    shards.clear();
+    metrics.latency = nullptr;
+    metrics.numLatency = 0;
+    delete[] latency;
+    latency = nullptr;
+    numLatency = 0;
+    return 0;
 }
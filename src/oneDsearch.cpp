@@ -69,6 +69,11 @@ double oneDsearch::paramUpdate() {
     
 }
 
+// Return the width of the bracket [a, b]
+double oneDsearch::Width() {
+    return fabs(b-a);
+}
+
 // Method to get the magnitude of dp
 bool oneDsearch::newError(double error) {
     switch (step) {
@@ -66,6 +66,11 @@ public:
      */
     double paramUpdate();
     
+    /*
+     * Width of the current search bracket
+     */
+    double Width();
+    
     /*
      * Get the magnitude of an array
      */